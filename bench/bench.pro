@@ -0,0 +1,16 @@
+# Loopback benchmark for kaukkis-server. Build with: qmake bench/bench.pro && make
+
+include(../src/src.pri)
+
+TARGET = kaukkis-bench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    loadclient.cpp
+
+HEADERS += \
+    loadclient.h
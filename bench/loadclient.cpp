@@ -0,0 +1,161 @@
+#include "loadclient.h"
+#include "message.h"
+#include "protocol.h"
+#include "stats.h"
+
+namespace
+{
+    //Bytes allowed to wait in the socket in as-fast-as-possible mode.
+    const qint64 MAX_BUFFERED = 64 * 1024;
+    //Rate mode checks how many events are due this often, in milliseconds.
+    const int TICK = 1;
+}
+
+SendLog::SendLog() :
+    sentAt_(SIZE, 0),
+    next_(1)
+{
+}
+
+quint32 SendLog::allocate(int count, qint64 sentAt)
+{
+    const quint32 first = next_;
+    for (int i = 0; i < count; ++i)
+    {
+        sentAt_[(first + i) & MASK] = sentAt;
+    }
+    next_ += count;
+    return first;
+}
+
+LoadClient::LoadClient(const Options& options, SendLog* sendLog, QObject* parent) :
+    QObject(parent),
+    options_(options),
+    sendLog_(sendLog),
+    sent_(0),
+    startedAt_(0),
+    running_(false)
+{
+    options_.burst = qMax(options_.burst, 1u);
+    buffer_.reserve(Protocol::FRAME_HEADER_SIZE + 4
+                    + options_.burst * qMax(Protocol::MAX_KEY_EVENT_SIZE, Message::SIZE));
+    timer_.setTimerType(Qt::PreciseTimer);
+    connect(&socket_, SIGNAL(connected()),
+            this, SLOT(connected()));
+    connect(&socket_, SIGNAL(readyRead()),
+            this, SLOT(discardReplies()));
+    connect(&timer_, SIGNAL(timeout()),
+            this, SLOT(sendBurst()));
+    if (options_.rate == 0)
+    {
+        connect(&socket_, SIGNAL(bytesWritten(qint64)),
+                this, SLOT(sendBurst()));
+    }
+}
+
+void LoadClient::start()
+{
+    running_ = true;
+    socket_.connectToHost(options_.host, options_.port);
+}
+
+void LoadClient::stop()
+{
+    running_ = false;
+    timer_.stop();
+}
+
+quint64 LoadClient::sent() const
+{
+    return sent_;
+}
+
+void LoadClient::connected()
+{
+    socket_.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    if (options_.v2)
+    {
+        QByteArray payload;
+        if (!options_.display.isEmpty())
+        {
+            Protocol::appendHelloOption(payload, Protocol::HelloOption::DISPLAY, options_.display.toUtf8());
+        }
+        socket_.write(Protocol::hello(Protocol::VERSION, payload));
+    }
+    if (options_.rate == 0)
+    {
+        sendBurst();
+    }
+    else
+    {
+        startedAt_ = Stats::now();
+        timer_.start(TICK);
+    }
+}
+
+void LoadClient::sendBurst()
+{
+    if (!running_)
+    {
+        return;
+    }
+    if (options_.rate != 0)
+    {
+        //Sends what is due since the start rather than one burst per tick,
+        //so neither timer granularity nor late ticks skew the rate.
+        const quint64 due = static_cast<quint64>(Stats::now() - startedAt_) * options_.rate / 1000000000;
+        while (due >= sent_ + options_.burst)
+        {
+            writeBurst();
+        }
+        return;
+    }
+    while (running_ && socket_.bytesToWrite() < MAX_BUFFERED)
+    {
+        writeBurst();
+    }
+}
+
+void LoadClient::discardReplies()
+{
+    socket_.readAll();
+}
+
+void LoadClient::writeBurst()
+{
+    const int count = options_.burst;
+    buffer_.resize(0);
+    if (options_.v2)
+    {
+        char event[Protocol::MAX_KEY_EVENT_SIZE];
+        char header[Protocol::FRAME_HEADER_SIZE + 4];
+        buffer_.append(header, sizeof(header));
+        const quint32 sequence = sendLog_->allocate(count, Stats::now());
+        for (int i = 0; i < count; ++i)
+        {
+            const quint64 n = sent_ + i;
+            const Message::Action action = n % 2 == 0 ?
+                        Message::Action::KEY_PRESS : Message::Action::KEY_RELEASE;
+            const Qt::Key key = static_cast<Qt::Key>(Qt::Key_A + (n / 2) % 26);
+            buffer_.append(event, Protocol::encodeKeyEvent(action, key, event));
+        }
+        uchar* frame = reinterpret_cast<uchar*>(buffer_.data());
+        qToBigEndian<quint16>(buffer_.size() - 2, frame);
+        frame[2] = static_cast<uchar>(Protocol::FrameType::BATCH);
+        qToBigEndian<quint32>(sequence, frame + Protocol::FRAME_HEADER_SIZE);
+    }
+    else
+    {
+        char frame[Message::SIZE];
+        for (int i = 0; i < count; ++i)
+        {
+            const quint64 n = sent_ + i;
+            const Message::Action action = n % 2 == 0 ?
+                        Message::Action::KEY_PRESS : Message::Action::KEY_RELEASE;
+            Message(action, static_cast<Qt::Key>(Qt::Key_A + (n / 2) % 26)).serialize(frame);
+            buffer_.append(frame, Message::SIZE);
+        }
+    }
+    socket_.write(buffer_);
+    sent_ += count;
+}
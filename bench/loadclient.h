@@ -0,0 +1,72 @@
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include <QObject>
+#include <QTimer>
+#include <QByteArray>
+#include <QtNetwork/QTcpSocket>
+#include <QVector>
+
+//Send time of every v2 sequence number handed out during a run. Sequence
+//numbers are unique across all clients so the inject hook can match an
+//injected event to the moment it was written.
+class SendLog
+{
+public:
+    SendLog();
+
+    quint32 allocate(int count, qint64 sentAt);
+    inline qint64 sentAt(quint32 sequence) const
+    {
+        return sentAt_[sequence & MASK];
+    }
+
+private:
+    static const int SIZE = 1 << 20;
+    static const quint32 MASK = SIZE - 1;
+
+    QVector<qint64> sentAt_;
+    quint32 next_;
+};
+
+//Synthetic Kaukkis client. Sends press/release pairs cycling through the
+//letter keys, either at a steady rate or as fast as the socket drains.
+class LoadClient : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        QString host;
+        quint16 port;
+        bool v2;
+        unsigned rate;  //Events per second, 0 for as fast as possible.
+        unsigned burst; //Events per write.
+        QString display; //Chosen in the v2 hello, empty for the default.
+    };
+
+    LoadClient(const Options& options, SendLog* sendLog, QObject* parent = 0);
+
+    void start();
+    void stop();
+    quint64 sent() const;
+
+private slots:
+    void connected();
+    void sendBurst();
+    void discardReplies();
+
+private:
+    Options options_;
+    SendLog* sendLog_;
+    QTcpSocket socket_;
+    QTimer timer_;
+    QByteArray buffer_;
+    quint64 sent_;
+    qint64 startedAt_; //Stats::now() when rate mode started sending
+    bool running_;
+
+    void writeBurst();
+};
+
+#endif // LOADCLIENT_H
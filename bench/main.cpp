@@ -0,0 +1,142 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <QList>
+#include <atomic>
+#include "server.h"
+#include "histogram.h"
+#include "loadclient.h"
+#include "log.h"
+
+//Loopback benchmark: replays synthetic key streams from many clients and
+//reports throughput and end-to-end latency (client write to injection). The
+//server runs in-process with the null backend by default, or against the
+//display in $DISPLAY (for example Xvfb) with --backend xlib or xcb. With --host an external
+//server is loaded instead and only the send side is measured.
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("kaukkis bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator and benchmark for kaukkis server.");
+    parser.addHelpOption();
+    QCommandLineOption clientsOption({"c","clients"}, "Concurrent clients. Default: 1", "count", "1");
+    parser.addOption(clientsOption);
+    QCommandLineOption rateOption({"r","rate"}, "Events per second per client, 0 for as fast as "
+                                  "possible. Default: 1000", "events", "1000");
+    parser.addOption(rateOption);
+    QCommandLineOption burstOption({"b","burst"}, "Events per write. Default: 2", "events", "2");
+    parser.addOption(burstOption);
+    QCommandLineOption durationOption({"d","duration"}, "Run time. Default: 5", "seconds", "5");
+    parser.addOption(durationOption);
+    QCommandLineOption protocolOption("protocol", "legacy or v2. Default: v2", "protocol", "v2");
+    parser.addOption(protocolOption);
+    QCommandLineOption hostOption("host", "Loads an external server instead of an in-process one.", "host");
+    parser.addOption(hostOption);
+    QCommandLineOption portOption({"p","port"}, "Server port. Default: 4386", "port", "4386");
+    parser.addOption(portOption);
+    QCommandLineOption backendOption("backend", "Server injection backend: null, xlib or xcb. xlib and "
+                                     "xcb inject into $DISPLAY. Default: null", "backend", "null");
+    parser.addOption(backendOption);
+    QCommandLineOption displayOption("display", "Server display. Repeat to spread the clients over "
+                                     "several displays (v2 only); any names work with the null "
+                                     "backend. Default: $DISPLAY", "name");
+    parser.addOption(displayOption);
+    QCommandLineOption flushWindowOption({"f","flush-window"}, "Server flush window. Default: 0",
+                                         "microseconds", "0");
+    parser.addOption(flushWindowOption);
+    parser.process(a);
+
+    Log::setLevel(Log::Level::WARNING);
+    const bool inProcess = !parser.isSet(hostOption);
+    const bool v2 = parser.value("protocol") == "v2";
+    const int duration = parser.value("duration").toInt();
+
+    const QStringList displays = parser.values("display");
+    SendLog sendLog;
+    //One histogram per display, as each is written by its injection thread.
+    QVector<LatencyHistogram*> latencies;
+    std::atomic<quint64> injected(0);
+    Server* server = NULL;
+    if (inProcess)
+    {
+        server = new Server(0, parser.value("backend"), displays);
+        server->setFlushWindow(parser.value("flush-window").toUInt());
+        for (int i = 0; i < server->displayCount(); ++i)
+        {
+            LatencyHistogram* latency = new LatencyHistogram();
+            latencies.append(latency);
+            server->injector(i).setInjectHook([&, latency](const InputEvent& event) {
+                //Only v2 events carry the sequence number needed for matching.
+                if (event.sequence != 0)
+                {
+                    latency->record(Stats::now() - sendLog.sentAt(event.sequence));
+                }
+                injected.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+        if (!server->listen(parser.value("port").toUInt()))
+        {
+            return 1;
+        }
+    }
+
+    LoadClient::Options options;
+    options.host = inProcess ? QString("127.0.0.1") : parser.value("host");
+    options.port = parser.value("port").toUShort();
+    options.v2 = v2;
+    options.rate = parser.value("rate").toUInt();
+    //A batch frame has room for about 2000 compact events.
+    options.burst = qMin(parser.value("burst").toUInt(), v2 ? 2000u : 100000u);
+
+    QList<LoadClient*> clients;
+    for (int i = 0; i < parser.value("clients").toInt(); ++i)
+    {
+        options.display = displays.isEmpty() ? QString() : displays[i % displays.size()];
+        LoadClient* client = new LoadClient(options, &sendLog, &a);
+        clients.append(client);
+        client->start();
+    }
+
+    QTimer::singleShot(duration * 1000, [&]() {
+        for (LoadClient* client : clients)
+        {
+            client->stop();
+        }
+        //Give the server a moment to drain what is still in flight.
+        QTimer::singleShot(500, [&]() {
+            quint64 sent = 0;
+            for (const LoadClient* client : clients)
+            {
+                sent += client->sent();
+            }
+            printf("clients %d protocol %s rate %u burst %u duration_s %d\n", clients.size(),
+                   v2 ? "v2" : "legacy", options.rate, options.burst, duration);
+            printf("sent %llu events_per_s %.0f\n", static_cast<unsigned long long>(sent),
+                   static_cast<double>(sent) / duration);
+            if (inProcess)
+            {
+                printf("injected %llu events_per_s %.0f\n",
+                       static_cast<unsigned long long>(injected.load()),
+                       static_cast<double>(injected.load()) / duration);
+                for (int i = 0; i < latencies.size(); ++i)
+                {
+                    const LatencyHistogram& latency = *latencies[i];
+                    printf("latency_us display %d count %llu p50 %.1f p99 %.1f p999 %.1f max %.1f\n", i,
+                           static_cast<unsigned long long>(latency.count()),
+                           latency.percentile(0.5) / 1000.0, latency.percentile(0.99) / 1000.0,
+                           latency.percentile(0.999) / 1000.0, latency.max() / 1000.0);
+                }
+                printf("server stats\n%s", server->statsReport().toUtf8().constData());
+            }
+            fflush(stdout);
+            QCoreApplication::quit();
+        });
+    });
+
+    const int result = a.exec();
+    delete server;
+    qDeleteAll(latencies);
+    return result;
+}
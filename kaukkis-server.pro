@@ -4,25 +4,15 @@
 #
 #-------------------------------------------------
 
-QT       += core network gui
-
-CONFIG += C++11
-LIBS += -lXtst -lX11
+include(src/src.pri)
 
 TARGET = kaukkis-server
-INCLUDEPATH += src
 CONFIG   += console
 CONFIG   -= app_bundle
 
 TEMPLATE = app
 
 
-SOURCES += src/main.cpp \
-    src/server.cpp \
-    src/message.cpp
-
-HEADERS += \
-    src/server.h \
-    src/message.h
+SOURCES += src/main.cpp
 
 DISTFILES +=
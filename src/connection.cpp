@@ -0,0 +1,245 @@
+#include "connection.h"
+#include "protocol.h"
+#include "log.h"
+#include "stats.h"
+#include "recorder.h"
+#include "realtime.h"
+#include <QtNetwork/QHostAddress>
+
+Connection::Connection(QTcpSocket* socket, Stats* stats, QObject* parent) :
+    QObject(parent),
+    socket_(socket),
+    peerName_(socket->peerAddress().toString() + ":" + QString::number(socket->peerPort())),
+    stats_(stats),
+    messageCount_(0),
+    byteCount_(0),
+    paused_(false),
+    recorder_(NULL),
+    stream_(0),
+    quickAck_(false),
+    client_(0),
+    session_(0),
+    ackClient_(0)
+{
+    socket_->setParent(this);
+    socket_->setReadBufferSize(READ_BUFFER_SIZE);
+    connect(socket_, SIGNAL(readyRead()),
+            this, SLOT(readMessages()));
+    connect(socket_, SIGNAL(disconnected()),
+            this, SLOT(socketDisconnected()));
+}
+
+Connection::~Connection()
+{
+    socket_->disconnect(this);
+}
+
+QString Connection::peerName() const
+{
+    return peerName_;
+}
+
+quint64 Connection::messageCount() const
+{
+    return messageCount_;
+}
+
+quint64 Connection::byteCount() const
+{
+    return byteCount_;
+}
+
+void Connection::pause()
+{
+    paused_ = true;
+}
+
+void Connection::resume()
+{
+    if (paused_)
+    {
+        paused_ = false;
+        //Not called directly: resume() may run inside a messagesReceived
+        //handler, and bytes already in the socket buffer get no readyRead.
+        QMetaObject::invokeMethod(this, "readMessages", Qt::QueuedConnection);
+    }
+}
+
+bool Connection::isPaused() const
+{
+    return paused_;
+}
+
+void Connection::abort()
+{
+    paused_ = true;
+    socket_->abort();
+}
+
+void Connection::setLowLatency()
+{
+    quickAck_ = true;
+    decoder_.prefault();
+}
+
+quint32 Connection::client() const
+{
+    return client_;
+}
+
+void Connection::setClient(quint32 client)
+{
+    client_ = client;
+}
+
+quint64 Connection::session() const
+{
+    return session_;
+}
+
+void Connection::setSession(quint64 session)
+{
+    session_ = session;
+}
+
+void Connection::setHelloReply(const QByteArray& payload)
+{
+    helloReply_ = payload;
+}
+
+quint32 Connection::ackClient() const
+{
+    return ackClient_;
+}
+
+void Connection::setAckClient(quint32 ackClient)
+{
+    ackClient_ = ackClient;
+}
+
+//The socket buffers the frame until the event loop writes it, so acks
+//written in one pass go out together.
+void Connection::sendAck(quint32 sequence, quint32 events, qint64 oldest, qint64 newest)
+{
+    const qint64 MAX_MICROSECONDS = 0xffffffffLL;
+    char frame[Protocol::ACK_FRAME_SIZE];
+    Protocol::encodeAck(frame, sequence, events, qMin(oldest / 1000, MAX_MICROSECONDS),
+                        qMin(newest / 1000, MAX_MICROSECONDS));
+    socket_->write(frame, sizeof(frame));
+}
+
+void Connection::setRecorder(Recorder* recorder, quint32 stream)
+{
+    recorder_ = recorder;
+    stream_ = stream;
+}
+
+//Reads straight into the decoder buffer and hands out every complete
+//message. Partial messages stay in the decoder until the rest arrives.
+void Connection::readMessages()
+{
+    //A paused client is read again by resume(). Decoding now would push
+    //another span past the one that filled its queue.
+    if (paused_)
+    {
+        return;
+    }
+    const qint64 readyAt = Stats::now();
+    //Messages left in the decoder by a pause go first.
+    if (!decodeMessages(readyAt))
+    {
+        return;
+    }
+    while (!paused_ && socket_->bytesAvailable() > 0)
+    {
+        const qint64 readStart = Stats::now();
+        char* data = decoder_.writePointer();
+        const qint64 bytes = socket_->read(data, decoder_.writeSpace());
+        if (bytes <= 0)
+        {
+            break;
+        }
+        if (quickAck_)
+        {
+            Realtime::quickAck(socket_->socketDescriptor());
+        }
+        if (recorder_ != NULL)
+        {
+            recorder_->append(stream_, readyAt, data, bytes);
+        }
+        decoder_.commit(bytes);
+        byteCount_ += bytes;
+        stats_->record(Stats::READ, Stats::now() - readStart);
+        stats_->addReceived(0, bytes);
+        if (!decodeMessages(readyAt))
+        {
+            return;
+        }
+    }
+}
+
+//Emits decoded messages until the decoder runs dry or the connection is
+//paused. Returns false if the connection was aborted.
+bool Connection::decodeMessages(qint64 receivedAt)
+{
+    if (paused_)
+    {
+        return socket_->state() == QAbstractSocket::ConnectedState;
+    }
+    qint64 decodeStart = Stats::now();
+    while (true)
+    {
+        MessageSpan messages = decoder_.decode();
+        //The hello comes before the messages decoded with it, which may
+        //depend on the options it carries.
+        if (decoder_.takeHello() && !acceptHello())
+        {
+            return false;
+        }
+        if (messages.size == 0)
+        {
+            break;
+        }
+        const qint64 decoded = Stats::now();
+        stats_->record(Stats::DECODE, decoded - decodeStart);
+        stats_->addReceived(messages.size, 0);
+        messageCount_ += messages.size;
+        messages.receivedAt = receivedAt;
+        emit messagesReceived(messages);
+        if (paused_)
+        {
+            break;
+        }
+        decodeStart = Stats::now();
+    }
+    if (decoder_.mode() == MessageDecoder::Mode::ERROR)
+    {
+        LOG_WARNING("Connection: protocol error from", peerName_);
+        socket_->abort();
+        return false;
+    }
+    return socket_->state() == QAbstractSocket::ConnectedState;
+}
+
+//Lets the server check the hello options. Returns false if it rejected them
+//by aborting the connection.
+bool Connection::acceptHello()
+{
+    emit helloReceived(decoder_.helloPayload());
+    if (socket_->state() != QAbstractSocket::ConnectedState)
+    {
+        return false;
+    }
+    socket_->write(Protocol::hello(Protocol::VERSION, helloReply_));
+    LOG_INFO("Connection: protocol v2 with", peerName_);
+    return true;
+}
+
+void Connection::socketDisconnected()
+{
+    if (recorder_ != NULL)
+    {
+        recorder_->append(stream_, Stats::now(), NULL, 0);
+    }
+    emit closed(this);
+}
@@ -0,0 +1,85 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <QObject>
+#include <QtNetwork/QTcpSocket>
+#include "messagedecoder.h"
+
+class Stats;
+class Recorder;
+
+//One connected Kaukkis client. Reads are driven by readyRead so any number
+//of connections can be served from the event loop at the same time.
+class Connection : public QObject
+{
+    Q_OBJECT
+public:
+    Connection(QTcpSocket* socket, Stats* stats, QObject* parent = 0);
+    ~Connection();
+
+    QString peerName() const;
+    quint64 messageCount() const;
+    quint64 byteCount() const;
+
+    //Stops reading while the server cannot keep up. Unread bytes stay in
+    //the socket, whose buffer is bounded, so TCP flow control throttles the
+    //client.
+    void pause();
+    void resume();
+    bool isPaused() const;
+    void abort();
+    //Copies every read into the recording as the given stream.
+    void setRecorder(Recorder* recorder, quint32 stream);
+    //Acknowledges every read at once and prefaults the receive buffers.
+    //The socket options are set by Realtime::tuneSocket().
+    void setLowLatency();
+    //Identifies the client to the injection threads, which track the keys
+    //it holds. A resumed session keeps the client of the session.
+    quint32 client() const;
+    void setClient(quint32 client);
+    //Token of the session, zero for none. See Protocol::HelloOption::SESSION.
+    quint64 session() const;
+    void setSession(quint64 session);
+    //Options of the hello sent in reply, set while handling helloReceived.
+    void setHelloReply(const QByteArray& payload);
+    //Nonzero once the client asked for acks, see Protocol::FrameType::ACK.
+    quint32 ackClient() const;
+    void setAckClient(quint32 ackClient);
+    //Writes an ACK frame. Latencies are in nanoseconds.
+    void sendAck(quint32 sequence, quint32 events, qint64 oldest, qint64 newest);
+
+signals:
+    //Emitted once per read with every complete message in it.
+    void messagesReceived(const MessageSpan& messages);
+    //Emitted for a v2 hello before the messages following it. Aborting the
+    //connection rejects the client.
+    void helloReceived(const QByteArray& payload);
+    void closed(Connection* connection);
+
+private slots:
+    void readMessages();
+    void socketDisconnected();
+
+private:
+    static const int READ_BUFFER_SIZE = 64 * 1024;
+
+    QTcpSocket* socket_;
+    MessageDecoder decoder_;
+    QString peerName_;
+    Stats* stats_;
+    quint64 messageCount_;
+    quint64 byteCount_;
+    bool paused_;
+    Recorder* recorder_;
+    quint32 stream_;
+    bool quickAck_;
+    quint32 client_;
+    quint64 session_;
+    QByteArray helloReply_;
+    quint32 ackClient_;
+
+    bool decodeMessages(qint64 receivedAt);
+    bool acceptHello();
+};
+
+#endif // CONNECTION_H
@@ -0,0 +1,270 @@
+#include "eventqueue.h"
+#include <QHash>
+#include <qnamespace.h>
+
+namespace
+{
+    bool isModifier(quint32 key)
+    {
+        switch (key)
+        {
+            case Qt::Key_Shift:
+            case Qt::Key_Control:
+            case Qt::Key_Meta:
+            case Qt::Key_Alt:
+            case Qt::Key_AltGr:
+            case Qt::Key_Super_L:
+            case Qt::Key_Super_R:
+            case Qt::Key_Hyper_L:
+            case Qt::Key_Hyper_R:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+EventQueue::EventQueue(int capacity, qint64 staleAfter, int overshoot) :
+    head_(0),
+    capacity_(capacity),
+    reserved_(capacity + overshoot),
+    staleAfter_(staleAfter),
+    target_(0),
+    collapsed_(0),
+    stale_(0),
+    overflow_(0)
+{
+    events_.reserve(reserved_);
+}
+
+void EventQueue::push(const InputEvent& event, bool dropWhenFull)
+{
+    bool press = false;
+    quint32 heldKey = event.key;
+    switch (event.type)
+    {
+        case InputEvent::Type::KEY_PRESS:
+            press = true;
+            break;
+        case InputEvent::Type::KEY_RELEASE:
+            break;
+        case InputEvent::Type::BUTTON_PRESS:
+            press = true;
+            heldKey = BUTTON_BASE | event.key;
+            break;
+        case InputEvent::Type::BUTTON_RELEASE:
+            heldKey = BUTTON_BASE | event.key;
+            break;
+        case InputEvent::Type::RELEASE_HELD:
+            held_.clear();
+            append(event);
+            return;
+        default:
+            //Taps, motion and scrolling leave nothing held.
+            if (dropWhenFull && isFull())
+            {
+                ++overflow_;
+                return;
+            }
+            append(event);
+            return;
+    }
+
+    const bool held = held_.contains(heldKey);
+    if (press)
+    {
+        if (held)
+        {
+            ++collapsed_;
+            return;
+        }
+        if (dropWhenFull && isFull())
+        {
+            ++overflow_;
+            return;
+        }
+        held_.insert(heldKey);
+    }
+    else if (held)
+    {
+        held_.remove(heldKey);
+    }
+    else if (dropWhenFull && isFull())
+    {
+        ++overflow_;
+        return;
+    }
+    append(event);
+}
+
+void EventQueue::append(const InputEvent& event)
+{
+    //Reuses the space of popped events before the vector has to grow.
+    if (head_ > 0 && events_.size() == events_.capacity())
+    {
+        events_.remove(0, head_);
+        head_ = 0;
+    }
+    events_.append(event);
+}
+
+void EventQueue::pop()
+{
+    ++head_;
+    if (head_ == events_.size())
+    {
+        events_.resize(0);
+        head_ = 0;
+    }
+}
+
+void EventQueue::dropStale(qint64 now)
+{
+    const qint64 deadline = now - staleAfter_;
+    if (staleAfter_ <= 0 || isEmpty() || events_[head_].receivedAt >= deadline)
+    {
+        return;
+    }
+
+    //Events are in receive order, so only a prefix of the queue is stale.
+    //A release there matches the latest unmatched press of the same key.
+    QHash<quint32, int> openPresses;
+    int dropped = 0;
+    for (int i = head_; i < events_.size() && events_[i].receivedAt < deadline; ++i)
+    {
+        InputEvent& event = events_[i];
+        if (event.type == InputEvent::Type::KEY_PRESS)
+        {
+            openPresses.insert(event.key, i);
+            continue;
+        }
+        if (event.type != InputEvent::Type::KEY_RELEASE)
+        {
+            //Typed text is never stale.
+            continue;
+        }
+        const QHash<quint32, int>::iterator press = openPresses.find(event.key);
+        if (press == openPresses.end())
+        {
+            continue;
+        }
+        if (canDropPair(press.value(), i))
+        {
+            events_[press.value()].key = DROPPED_KEY;
+            event.key = DROPPED_KEY;
+            dropped += 2;
+        }
+        openPresses.erase(press);
+    }
+    if (dropped == 0)
+    {
+        return;
+    }
+
+    int write = head_;
+    for (int read = head_; read < events_.size(); ++read)
+    {
+        const InputEvent& event = events_[read];
+        const bool keyEvent = event.type == InputEvent::Type::KEY_PRESS
+                || event.type == InputEvent::Type::KEY_RELEASE;
+        if (!keyEvent || event.key != DROPPED_KEY)
+        {
+            events_[write++] = events_[read];
+        }
+    }
+    events_.resize(write);
+    stale_ += dropped;
+    if (head_ == events_.size())
+    {
+        events_.resize(0);
+        head_ = 0;
+    }
+}
+
+//Pairs inside the range were decided before it closes, so the events
+//already marked are the ones going away.
+bool EventQueue::canDropPair(int press, int release) const
+{
+    const bool modifierPair = isModifier(events_[press].key);
+    QHash<quint32, int> modifiersDown;
+    for (int i = press + 1; i < release; ++i)
+    {
+        const InputEvent& event = events_[i];
+        const bool keyEvent = event.type == InputEvent::Type::KEY_PRESS
+                || event.type == InputEvent::Type::KEY_RELEASE;
+        if (keyEvent && event.key == DROPPED_KEY)
+        {
+            continue;
+        }
+        if (modifierPair)
+        {
+            return false;
+        }
+        if (!keyEvent || !isModifier(event.key))
+        {
+            continue;
+        }
+        int& down = modifiersDown[event.key];
+        if (event.type == InputEvent::Type::KEY_PRESS)
+        {
+            ++down;
+        }
+        else if (down == 0)
+        {
+            return false;
+        }
+        else
+        {
+            --down;
+        }
+    }
+    for (int down : modifiersDown)
+    {
+        if (down != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void EventQueue::prefault()
+{
+    if (isEmpty())
+    {
+        //Shrinking keeps the capacity.
+        events_.resize(reserved_);
+        events_.resize(0);
+        head_ = 0;
+    }
+}
+
+int EventQueue::capacity() const
+{
+    return capacity_;
+}
+
+int EventQueue::target() const
+{
+    return target_;
+}
+
+void EventQueue::setTarget(int target)
+{
+    target_ = target;
+}
+
+quint64 EventQueue::collapsed() const
+{
+    return collapsed_;
+}
+
+quint64 EventQueue::stale() const
+{
+    return stale_;
+}
+
+quint64 EventQueue::overflow() const
+{
+    return overflow_;
+}
@@ -0,0 +1,85 @@
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <QVector>
+#include <QSet>
+#include "inputevent.h"
+
+//Events of one client waiting for room in the injection queue. The queue is
+//bounded: presses of a key or button the client already holds are
+//collapsed, and key press/release pairs that waited too long are dropped
+//together, so after a stall the keyboard state catches up instead of
+//replaying every stale tap.
+//A release of a held key or button is never dropped, so capacity() may be
+//exceeded by the number of held keys and buttons. A client that is blocked
+//rather than dropped once full may also exceed it by the rest of the span
+//it was read with; that much is reserved on top of capacity().
+class EventQueue
+{
+public:
+    //staleAfter is in nanoseconds, zero never drops stale pairs. overshoot
+    //is the largest span pushed without dropping after the queue is full.
+    EventQueue(int capacity, qint64 staleAfter, int overshoot = 0);
+
+    //Queues the event unless it is a repeated press of a held key or
+    //button. When the queue is full and dropWhenFull is set, everything but
+    //releases of held keys and buttons is dropped instead. A RELEASE_HELD
+    //is always queued and leaves nothing held.
+    void push(const InputEvent& event, bool dropWhenFull);
+    inline const InputEvent& front() const
+    {
+        return events_[head_];
+    }
+    void pop();
+    //Drops matched press/release pairs received before now - staleAfter.
+    //A pair is kept when dropping it would change what other events mean:
+    //when modifiers change between its press and release without changing
+    //back, or when it is a modifier pair around events that stay.
+    void dropStale(qint64 now);
+
+    inline int size() const
+    {
+        return events_.size() - head_;
+    }
+    inline bool isEmpty() const
+    {
+        return size() == 0;
+    }
+    inline bool isFull() const
+    {
+        return size() >= capacity_;
+    }
+    int capacity() const;
+    //Touches the reserved space so queueing does not fault pages in.
+    void prefault();
+    //Index of the display the events go to.
+    int target() const;
+    void setTarget(int target);
+
+    quint64 collapsed() const;
+    quint64 stale() const;
+    quint64 overflow() const;
+
+private:
+    //Marks key events removed by dropStale() before the queue is compacted.
+    static const quint32 DROPPED_KEY = 0;
+    //Buttons are kept apart from keys in held_. Qt keys stay below this.
+    static const quint32 BUTTON_BASE = 0x80000000;
+
+    QVector<InputEvent> events_;
+    int head_;
+    int capacity_;
+    int reserved_;
+    qint64 staleAfter_;
+    int target_;
+    //Keys and buttons whose last queued event is a press.
+    QSet<quint32> held_;
+    quint64 collapsed_;
+    quint64 stale_;
+    quint64 overflow_;
+
+    void append(const InputEvent& event);
+    bool canDropPair(int press, int release) const;
+};
+
+#endif // EVENTQUEUE_H
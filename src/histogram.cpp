@@ -0,0 +1,53 @@
+#include "histogram.h"
+
+LatencyHistogram::LatencyHistogram() :
+    count_(0),
+    max_(0)
+{
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        buckets_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::max() const
+{
+    return max_.load(std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::percentile(double fraction) const
+{
+    const quint64 total = count();
+    if (total == 0)
+    {
+        return 0;
+    }
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(fraction * total + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+        {
+            return qMin(bucketValue(i), max());
+        }
+    }
+    return max();
+}
+
+//Middle of the value range of a bucket.
+quint64 LatencyHistogram::bucketValue(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    const int shift = bucket / SUB_BUCKETS - 1;
+    const quint64 lower = static_cast<quint64>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lower + ((1ull << shift) >> 1);
+}
@@ -0,0 +1,55 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <QtGlobal>
+#include <atomic>
+
+//Log-linear latency histogram in nanoseconds. Every power of two is split
+//into eight buckets, so a value is off by at most 12.5 %. Recording is a few
+//instructions and never allocates. There must be a single writer thread;
+//readers in other threads may see a slightly stale histogram.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    inline void record(quint64 nanoseconds, quint64 count = 1)
+    {
+        std::atomic<quint64>& bucket = buckets_[bucketOf(nanoseconds)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        count_.store(count_.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        if (nanoseconds > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(nanoseconds, std::memory_order_relaxed);
+        }
+    }
+
+    quint64 count() const;
+    quint64 max() const;
+    //Value below which the given fraction (0..1) of the samples fall.
+    quint64 percentile(double fraction) const;
+
+private:
+    Q_DISABLE_COPY(LatencyHistogram)
+
+    static const int SUB_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int BUCKETS = 64 * SUB_BUCKETS;
+
+    std::atomic<quint64> buckets_[BUCKETS];
+    std::atomic<quint64> count_;
+    std::atomic<quint64> max_;
+
+    static inline int bucketOf(quint64 value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return static_cast<int>(value);
+        }
+        const int shift = 63 - __builtin_clzll(value) - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+    static quint64 bucketValue(int bucket);
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,44 @@
+#include "injectionbackend.h"
+#include "xlibbackend.h"
+#include "xcbbackend.h"
+#include "nullbackend.h"
+
+InjectionBackend::InjectionBackend()
+{
+    for (int& pending : pendingRemaps_)
+    {
+        pending = 0;
+    }
+}
+
+InjectionBackend* InjectionBackend::create(const QString& name)
+{
+    if (name == "xlib")
+    {
+        return new XlibBackend();
+    }
+    if (name == "xcb")
+    {
+        return new XcbBackend();
+    }
+    if (name == "null")
+    {
+        return new NullBackend();
+    }
+    return NULL;
+}
+
+void InjectionBackend::expectRemap(KeyCode keyCode)
+{
+    ++pendingRemaps_[keyCode];
+}
+
+bool InjectionBackend::takeRemap(int firstKeyCode, int count)
+{
+    if (count != 1 || firstKeyCode < 0 || firstKeyCode > 255 || pendingRemaps_[firstKeyCode] == 0)
+    {
+        return false;
+    }
+    --pendingRemaps_[firstKeyCode];
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef INJECTIONBACKEND_H
+#define INJECTIONBACKEND_H
+
+#include <QString>
+#include <X11/Xlib.h>
+
+class KeyMap;
+
+//Interface between the injection thread and whatever turns key and pointer
+//events into input: an X server through Xlib or XCB, or nothing at all for benchmarks.
+//All calls come from the injection thread.
+class InjectionBackend
+{
+public:
+    InjectionBackend();
+    virtual ~InjectionBackend() {}
+
+    //Connects to the display; NULL means $DISPLAY.
+    virtual bool open(const char* displayName) = 0;
+    //Resolves the keycodes of keyMap from the current keyboard mapping.
+    virtual void loadKeyMap(KeyMap& keyMap) = 0;
+    //Queues a key event. Nothing has to reach the server before flush().
+    virtual void fakeKey(KeyCode keyCode, bool press) = 0;
+    //Binds keySym to keyCode on every shift level, for keysyms missing from
+    //the keyboard mapping. The MappingNotify this causes is not reported by
+    //processEvents(), so it does not reload the key map.
+    virtual void remapKey(KeyCode keyCode, quint32 keySym) = 0;
+    //Pointer motion relative to the current position.
+    virtual void fakeMotion(int dx, int dy) = 0;
+    //Absolute pointer position on the current screen.
+    virtual void fakePosition(int x, int y) = 0;
+    virtual void fakeButton(unsigned button, bool press) = 0;
+    //Highest button of the pointer mapping. The X server rejects fake events
+    //of higher buttons.
+    virtual unsigned buttonCount() const = 0;
+    virtual void flush() = 0;
+    //Descriptor to poll for incoming events, -1 if there is none.
+    virtual int fd() const = 0;
+    //Handles incoming events. Returns true if the keyboard mapping changed.
+    virtual bool processEvents() = 0;
+    //True once the connection to the display is lost, for example because
+    //the X server restarted. The backend can only be deleted then.
+    virtual bool failed() const = 0;
+
+    //Returns NULL for an unknown name: "xlib", "xcb" or "null".
+    static InjectionBackend* create(const QString& name);
+
+protected:
+    //Bookkeeping of remapKey() for processEvents(): a MappingNotify of a
+    //single remapped keycode is our own.
+    void expectRemap(KeyCode keyCode);
+    bool takeRemap(int firstKeyCode, int count);
+
+private:
+    int pendingRemaps_[256];
+};
+
+#endif // INJECTIONBACKEND_H
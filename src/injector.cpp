@@ -0,0 +1,884 @@
+#include "injector.h"
+#include "stats.h"
+#include "log.h"
+#include "injectionbackend.h"
+#include "realtime.h"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <limits>
+#include <cerrno>
+
+namespace
+{
+    //Upper bound of events injected between two flushes.
+    const int MAX_BATCH = 1024;
+    //Delays between attempts to attach to the display, in nanoseconds.
+    const qint64 RETRY_MIN = 50 * 1000000LL;
+    const qint64 RETRY_MAX = 5 * 1000000000LL;
+
+    //Modifier keys pressed around a tap, in press order.
+    struct ModifierKey
+    {
+        unsigned char mask;
+        Qt::KeyboardModifier qtModifier;
+        Qt::Key key;
+    };
+    const ModifierKey MODIFIER_KEYS[] = {
+        { ShiftMask, Qt::ShiftModifier, Qt::Key_Shift },
+        { ControlMask, Qt::ControlModifier, Qt::Key_Control },
+        { Mod1Mask, Qt::AltModifier, Qt::Key_Alt },
+        { Mod4Mask, Qt::MetaModifier, Qt::Key_Meta },
+        //AltGr, ISO_Level3_Shift on XKB keyboards.
+        { Mod5Mask, Qt::GroupSwitchModifier, Qt::Key_AltGr }
+    };
+    const int MODIFIER_KEY_COUNT = sizeof(MODIFIER_KEYS) / sizeof(MODIFIER_KEYS[0]);
+
+    template <typename T>
+    bool playsLater(const T& a, const T& b)
+    {
+        return a.playAt > b.playAt || (a.playAt == b.playAt && a.order > b.order);
+    }
+}
+
+Injector::Injector(Stats* stats, QObject* parent) :
+    QThread(parent),
+    stats_(stats),
+    backend_(NULL),
+    attached_(false),
+    rejected_(0),
+    queue_(QUEUE_SIZE),
+    wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    acks_(ACK_QUEUE_SIZE),
+    ackFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    ackNotified_(false),
+    timerFd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    scheduleOrder_(0),
+    timerArmedAt_(0),
+    playedEarly_(0),
+    remapped_(0),
+    released_(0),
+    sleeping_(false),
+    stopping_(false),
+    flushWindow_(0),
+    motionTick_(0),
+    lastMotionAt_(0),
+    cpu_(-1),
+    fifoPriority_(0),
+    prefault_(false)
+{
+    pendingEvents_.reserve(MAX_BATCH);
+    pendingAcks_.reserve(MAX_BATCH);
+    scheduled_.reserve(MAX_SCHEDULED);
+    for (bool& down : keyDown_)
+    {
+        down = false;
+    }
+    motion_.pending = false;
+}
+
+Injector::~Injector()
+{
+    stop();
+    wait();
+    if (backend_ != NULL)
+    {
+        if (!backend_->failed())
+        {
+            backend_->flush();
+        }
+        delete backend_;
+    }
+    close(wakeFd_);
+    close(timerFd_);
+    close(ackFd_);
+}
+
+bool Injector::setDisplay(const QString& backend, const QString& name)
+{
+    InjectionBackend* probe = InjectionBackend::create(backend);
+    if (probe == NULL)
+    {
+        return false;
+    }
+    delete probe;
+    backendName_ = backend;
+    displayName_ = name.toLocal8Bit();
+    return true;
+}
+
+void Injector::setInjectHook(const InjectHook& hook)
+{
+    injectHook_ = hook;
+}
+
+void Injector::setFlushWindow(const unsigned microseconds)
+{
+    flushWindow_ = static_cast<qint64>(microseconds) * 1000;
+}
+
+void Injector::setMotionTick(const unsigned microseconds)
+{
+    motionTick_ = static_cast<qint64>(microseconds) * 1000;
+}
+
+void Injector::setRealtime(int cpu, int fifoPriority, bool prefault)
+{
+    cpu_ = cpu;
+    fifoPriority_ = fifoPriority;
+    prefault_ = prefault;
+    if (prefault)
+    {
+        queue_.prefault();
+        acks_.prefault();
+    }
+}
+
+bool Injector::isAttached() const
+{
+    return attached_.load();
+}
+
+quint64 Injector::rejected() const
+{
+    return rejected_.load(std::memory_order_relaxed);
+}
+
+quint64 Injector::released() const
+{
+    return released_.load(std::memory_order_relaxed);
+}
+
+quint64 Injector::remapped() const
+{
+    return remapped_.load(std::memory_order_relaxed);
+}
+
+quint64 Injector::playedEarly() const
+{
+    return playedEarly_.load(std::memory_order_relaxed);
+}
+
+void Injector::commit()
+{
+    //Pairs with the fence in waitForWork(): either the injection thread sees
+    //the pushed events or this thread sees it sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.exchange(false))
+    {
+        const quint64 one = 1;
+        if (write(wakeFd_, &one, sizeof(one)) < 0)
+        {
+            LOG_ERROR("Injector: wake-up failed");
+        }
+    }
+}
+
+int Injector::ackFd() const
+{
+    return ackFd_;
+}
+
+//Clears the notification before the queue is drained, so acks pushed
+//meanwhile notify again.
+void Injector::resetAckFd()
+{
+    quint64 value;
+    if (read(ackFd_, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+        LOG_ERROR("Injector: ack notification read failed");
+    }
+    ackNotified_.store(false);
+}
+
+void Injector::stop()
+{
+    stopping_ = true;
+    const quint64 one = 1;
+    if (write(wakeFd_, &one, sizeof(one)) < 0)
+    {
+        LOG_ERROR("Injector: wake-up failed");
+    }
+}
+
+void Injector::run()
+{
+    Realtime::enterThread("injector", cpu_, fifoPriority_);
+    if (prefault_)
+    {
+        Realtime::prefaultStack();
+        //Shrinking keeps the reserved capacity.
+        scheduled_.resize(MAX_SCHEDULED);
+        scheduled_.resize(0);
+        pendingEvents_.resize(MAX_BATCH);
+        pendingEvents_.resize(0);
+        pendingAcks_.resize(MAX_BATCH);
+        pendingAcks_.resize(0);
+    }
+    //Keysyms do not depend on the display, so the table is built once,
+    //before the first attach, and kept over reconnects.
+    keyMap_.build();
+    qint64 flushDeadline = 0;
+    qint64 retryAt = 0;
+    qint64 retryDelay = RETRY_MIN;
+    while (!stopping_)
+    {
+        if (backend_ != NULL && backend_->failed())
+        {
+            detach();
+        }
+        if (backend_ == NULL)
+        {
+            const qint64 now = Stats::now();
+            if (now >= retryAt)
+            {
+                if (attach())
+                {
+                    retryDelay = RETRY_MIN;
+                    continue;
+                }
+                if (retryDelay == RETRY_MIN)
+                {
+                    LOG_WARNING("Injector: display not available, retrying", QString::fromLocal8Bit(displayName_));
+                }
+                retryAt = now + retryDelay;
+                retryDelay = qMin(retryDelay * 2, RETRY_MAX);
+            }
+            reject();
+            waitForWork(qMax<qint64>(retryAt - Stats::now(), 0));
+            continue;
+        }
+
+        const bool wasIdle = pendingEvents_.isEmpty();
+        const int drained = drain();
+        const qint64 now = Stats::now();
+        playDue(now);
+        if (motion_.pending && now - lastMotionAt_ >= motionTick_)
+        {
+            injectMotion();
+        }
+        if (wasIdle && !pendingEvents_.isEmpty())
+        {
+            flushDeadline = now + flushWindow_;
+        }
+        if (!pendingEvents_.isEmpty() && (now >= flushDeadline || drained == MAX_BATCH))
+        {
+            flush();
+        }
+        qint64 timeout = pendingEvents_.isEmpty() ? -1 : flushDeadline - now;
+        if (motion_.pending)
+        {
+            const qint64 motionTimeout = lastMotionAt_ + motionTick_ - now;
+            timeout = timeout < 0 ? motionTimeout : qMin(timeout, motionTimeout);
+        }
+        armTimer();
+        waitForWork(timeout);
+    }
+    if (backend_ == NULL || backend_->failed())
+    {
+        reject();
+        return;
+    }
+    drain();
+    playDue(std::numeric_limits<qint64>::max());
+    if (motion_.pending)
+    {
+        injectMotion();
+    }
+    flush();
+}
+
+//Connects to the display and resolves the key table against its keyboard.
+bool Injector::attach()
+{
+    InjectionBackend* backend = InjectionBackend::create(backendName_);
+    if (!backend->open(displayName_.isEmpty() ? NULL : displayName_.constData()))
+    {
+        delete backend;
+        return false;
+    }
+    backend->loadKeyMap(keyMap_);
+    backend_ = backend;
+    attached_.store(true);
+    LOG_INFO("Injector: attached to display", QString::fromLocal8Bit(displayName_));
+    return true;
+}
+
+//Forgets everything tied to the lost X server: nothing is held down on a
+//new one, and events waiting for playout are rejected rather than played
+//into whatever session comes up next.
+void Injector::detach()
+{
+    LOG_ERROR("Injector: connection to the display lost, reattaching", QString::fromLocal8Bit(displayName_));
+    delete backend_;
+    backend_ = NULL;
+    attached_.store(false);
+    for (bool& down : keyDown_)
+    {
+        down = false;
+    }
+    heldKeys_.clear();
+    motion_.pending = false;
+    pendingEvents_.resize(0);
+    pendingAcks_.resize(0);
+    rejected_.fetch_add(scheduled_.size(), std::memory_order_relaxed);
+    scheduled_.resize(0);
+}
+
+void Injector::reject()
+{
+    InputEvent event;
+    quint64 count = 0;
+    while (queue_.pop(event))
+    {
+        ++count;
+    }
+    rejected_.fetch_add(count, std::memory_order_relaxed);
+}
+
+//Injects queued events, at most MAX_BATCH per call. Events to be played
+//later go to the jitter buffer.
+int Injector::drain()
+{
+    const qint64 now = Stats::now();
+    InputEvent event;
+    int count = 0;
+    while (count < MAX_BATCH && queue_.pop(event))
+    {
+        if (event.playAt > now)
+        {
+            schedule(event);
+        }
+        else
+        {
+            inject(event);
+        }
+        ++count;
+    }
+    return count;
+}
+
+void Injector::inject(const InputEvent& event)
+{
+    if (event.type == InputEvent::Type::POINTER_MOTION || event.type == InputEvent::Type::POINTER_POSITION)
+    {
+        mergeMotion(event);
+        return;
+    }
+    //Nothing overtakes earlier motion.
+    if (motion_.pending)
+    {
+        injectMotion();
+    }
+    if (event.type == InputEvent::Type::BUTTON_PRESS || event.type == InputEvent::Type::BUTTON_RELEASE
+            || event.type == InputEvent::Type::SCROLL)
+    {
+        injectPointer(event);
+        return;
+    }
+    if (event.type == InputEvent::Type::RELEASE_HELD)
+    {
+        releaseHeld(event);
+        return;
+    }
+
+    const qint64 lookupStart = Stats::now();
+    if (event.playAt != 0)
+    {
+        stats_->record(Stats::PLAYOUT, qMax<qint64>(lookupStart - event.playAt, 0));
+    }
+    KeyMap::Entry entry = lookup(event);
+    if (entry.keyCode == 0)
+    {
+        entry = bindSpareKeyCode(event, entry);
+    }
+    const qint64 injectStart = Stats::now();
+    stats_->record(Stats::LOOKUP, injectStart - lookupStart);
+    if (entry.keyCode == 0)
+    {
+        LOG_WARNING("Injector: Undetected key", Log::key(event.key));
+        return;
+    }
+    switch (event.type)
+    {
+        case InputEvent::Type::KEY_PRESS:
+            LOG_DEBUG("Injector: Key Press called.", Log::key(event.key));
+            fakeKey(entry.keyCode, true);
+            setHeld(event.client, false, entry.keyCode, true);
+            break;
+        case InputEvent::Type::KEY_RELEASE:
+            LOG_DEBUG("Injector: Key Release called.", Log::key(event.key));
+            fakeKey(entry.keyCode, false);
+            setHeld(event.client, false, entry.keyCode, false);
+            break;
+        default:
+            LOG_DEBUG("Injector: Key Tap called.", Log::key(event.key), Log::hex("modifiers", entry.modifiers));
+            tap(entry, event.type == InputEvent::Type::TEXT);
+            break;
+    }
+    stats_->record(Stats::INJECT, Stats::now() - injectStart);
+    if (injectHook_)
+    {
+        injectHook_(event);
+    }
+    addPending(event.receivedAt, 1);
+    addAck(event);
+}
+
+//Resolves the keycode of an event. For taps the modifiers of the entry are
+//the ones to hold down: those the keysym needs plus those of a chord.
+KeyMap::Entry Injector::lookup(const InputEvent& event) const
+{
+    if (event.type == InputEvent::Type::TEXT)
+    {
+        return keyMap_.findCharacter(event.key);
+    }
+    if (event.type != InputEvent::Type::CHORD)
+    {
+        return keyMap_.find(static_cast<Qt::Key>(event.key));
+    }
+    KeyMap::Entry entry = keyMap_.find(static_cast<Qt::Key>(event.key & ~Qt::KeyboardModifierMask));
+    for (const ModifierKey& modifier : MODIFIER_KEYS)
+    {
+        if (event.key & modifier.qtModifier)
+        {
+            entry.modifiers |= modifier.mask;
+        }
+    }
+    return entry;
+}
+
+//Types keysyms the keyboard mapping lacks, such as arbitrary Unicode
+//characters, through a spare keycode. Characters are bound exactly, case
+//included, so they need no Shift.
+KeyMap::Entry Injector::bindSpareKeyCode(const InputEvent& event, KeyMap::Entry entry)
+{
+    if (event.type == InputEvent::Type::TEXT)
+    {
+        entry.keySym = KeyMap::characterKeySym(event.key);
+        entry.modifiers = 0;
+    }
+    else if (entry.keySym == NoSymbol)
+    {
+        //Qt keys below the special range are the Unicode characters.
+        const quint32 key = event.type == InputEvent::Type::CHORD
+                ? event.key & ~Qt::KeyboardModifierMask : event.key;
+        if (key < 0x01000000)
+        {
+            entry.keySym = KeyMap::characterKeySym(key);
+        }
+    }
+    if (entry.keySym == NoSymbol)
+    {
+        return entry;
+    }
+    bool rebind = false;
+    entry.keyCode = keyMap_.spareKeyCodes().acquire(entry.keySym, keyDown_, rebind);
+    if (rebind)
+    {
+        LOG_DEBUG("Injector: binding spare keycode", Log::hex("keysym", entry.keySym),
+                  Log::field("keycode", entry.keyCode));
+        backend_->remapKey(entry.keyCode, entry.keySym);
+        remapped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return entry;
+}
+
+void Injector::fakeKey(KeyCode keyCode, bool press)
+{
+    keyDown_[keyCode] = press;
+    backend_->fakeKey(keyCode, press);
+}
+
+//Presses and releases the key with its modifiers held. Modifiers that are
+//already down stay down, unless the tap types text: then those the entry
+//does not need are let up around it, so a held Shift or Control does not
+//change the character.
+void Injector::tap(const KeyMap::Entry& entry, bool exact)
+{
+    KeyCode pressed[MODIFIER_KEY_COUNT];
+    int pressedCount = 0;
+    KeyCode released[MODIFIER_KEY_COUNT];
+    int releasedCount = 0;
+    for (const ModifierKey& modifier : MODIFIER_KEYS)
+    {
+        const KeyCode keyCode = keyMap_.find(modifier.key).keyCode;
+        if (keyCode == 0)
+        {
+            continue;
+        }
+        const bool needed = entry.modifiers & modifier.mask;
+        if (needed && !keyDown_[keyCode])
+        {
+            fakeKey(keyCode, true);
+            pressed[pressedCount++] = keyCode;
+        }
+        else if (!needed && exact && keyDown_[keyCode])
+        {
+            fakeKey(keyCode, false);
+            released[releasedCount++] = keyCode;
+        }
+    }
+    fakeKey(entry.keyCode, true);
+    fakeKey(entry.keyCode, false);
+    while (pressedCount > 0)
+    {
+        fakeKey(pressed[--pressedCount], false);
+    }
+    while (releasedCount > 0)
+    {
+        fakeKey(released[--releasedCount], true);
+    }
+}
+
+//A full jitter buffer plays its earliest event ahead of time rather than
+//dropping anything, which would break press/release pairs.
+void Injector::schedule(const InputEvent& event)
+{
+    if (scheduled_.size() >= MAX_SCHEDULED)
+    {
+        std::pop_heap(scheduled_.begin(), scheduled_.end(), playsLater<Scheduled>);
+        const InputEvent early = scheduled_.last().event;
+        scheduled_.removeLast();
+        playedEarly_.store(playedEarly_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        inject(early);
+    }
+    Scheduled scheduled;
+    scheduled.playAt = event.playAt;
+    scheduled.order = scheduleOrder_++;
+    scheduled.event = event;
+    scheduled_.append(scheduled);
+    std::push_heap(scheduled_.begin(), scheduled_.end(), playsLater<Scheduled>);
+}
+
+void Injector::playDue(qint64 now)
+{
+    while (!scheduled_.isEmpty() && scheduled_.first().playAt <= now)
+    {
+        std::pop_heap(scheduled_.begin(), scheduled_.end(), playsLater<Scheduled>);
+        const InputEvent event = scheduled_.last().event;
+        scheduled_.removeLast();
+        inject(event);
+    }
+}
+
+//Arms the timerfd for the earliest event in the jitter buffer. An absolute
+//CLOCK_MONOTONIC deadline does not drift like a relative poll timeout.
+void Injector::armTimer()
+{
+    const qint64 next = scheduled_.isEmpty() ? 0 : scheduled_.first().playAt;
+    if (next == timerArmedAt_)
+    {
+        return;
+    }
+    itimerspec deadline = {};
+    deadline.it_value.tv_sec = next / 1000000000;
+    deadline.it_value.tv_nsec = next % 1000000000;
+    if (timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &deadline, NULL) < 0)
+    {
+        LOG_ERROR("Injector: arming the playout timer failed");
+    }
+    timerArmedAt_ = next;
+}
+
+void Injector::mergeMotion(const InputEvent& event)
+{
+    if (!motion_.pending)
+    {
+        motion_.pending = true;
+        motion_.absolute = false;
+        motion_.x = 0;
+        motion_.y = 0;
+        motion_.receivedAt = event.receivedAt;
+        motion_.events = 0;
+    }
+    if (event.type == InputEvent::Type::POINTER_POSITION)
+    {
+        //Earlier relative motion no longer matters.
+        motion_.absolute = true;
+        motion_.x = event.x();
+        motion_.y = event.y();
+    }
+    else
+    {
+        motion_.x += event.x();
+        motion_.y += event.y();
+    }
+    ++motion_.events;
+    if (injectHook_)
+    {
+        injectHook_(event);
+    }
+}
+
+void Injector::injectMotion()
+{
+    const qint64 injectStart = Stats::now();
+    if (motion_.absolute)
+    {
+        backend_->fakePosition(motion_.x, motion_.y);
+    }
+    else if (motion_.x != 0 || motion_.y != 0)
+    {
+        backend_->fakeMotion(motion_.x, motion_.y);
+    }
+    lastMotionAt_ = Stats::now();
+    stats_->record(Stats::INJECT, lastMotionAt_ - injectStart);
+    LOG_DEBUG("Injector: Motion called.", Log::field("x", motion_.x), Log::field("y", motion_.y),
+              Log::field("merged", motion_.events));
+    addPending(motion_.receivedAt, motion_.events);
+    motion_.pending = false;
+}
+
+//Buttons and scrolling. Scrolling taps the wheel buttons once per notch.
+void Injector::injectPointer(const InputEvent& event)
+{
+    const qint64 injectStart = Stats::now();
+    if (event.type == InputEvent::Type::SCROLL)
+    {
+        LOG_DEBUG("Injector: Scroll called.", Log::field("x", event.x()), Log::field("y", event.y()));
+        //A pointer without wheel buttons cannot scroll.
+        const unsigned verticalButton = event.y() < 0 ? 4 : 5;
+        for (int i = verticalButton <= backend_->buttonCount() ? qAbs(static_cast<int>(event.y())) : 0;
+             i > 0; --i)
+        {
+            backend_->fakeButton(verticalButton, true);
+            backend_->fakeButton(verticalButton, false);
+        }
+        const unsigned horizontalButton = event.x() < 0 ? 6 : 7;
+        for (int i = horizontalButton <= backend_->buttonCount() ? qAbs(static_cast<int>(event.x())) : 0;
+             i > 0; --i)
+        {
+            backend_->fakeButton(horizontalButton, true);
+            backend_->fakeButton(horizontalButton, false);
+        }
+    }
+    else if (event.key == 0 || event.key > backend_->buttonCount())
+    {
+        LOG_WARNING("Injector: Invalid button", Log::field("button", event.key));
+        return;
+    }
+    else
+    {
+        const bool press = event.type == InputEvent::Type::BUTTON_PRESS;
+        LOG_DEBUG(press ? "Injector: Button Press called." : "Injector: Button Release called.",
+                  Log::field("button", event.key));
+        backend_->fakeButton(event.key, press);
+        setHeld(event.client, true, event.key, press);
+    }
+    stats_->record(Stats::INJECT, Stats::now() - injectStart);
+    if (injectHook_)
+    {
+        injectHook_(event);
+    }
+    addPending(event.receivedAt, 1);
+    addAck(event);
+}
+
+//Releases never add a client, so only clients holding something have an
+//entry until their RELEASE_HELD.
+void Injector::setHeld(quint32 client, bool button, unsigned code, bool down)
+{
+    if (client == 0)
+    {
+        return;
+    }
+    if (down)
+    {
+        HeldKeys& held = heldKeys_[client];
+        (button ? held.buttons : held.keyCodes).set(code);
+        return;
+    }
+    const QHash<quint32, HeldKeys>::iterator held = heldKeys_.find(client);
+    if (held != heldKeys_.end())
+    {
+        (button ? held->buttons : held->keyCodes).reset(code);
+    }
+}
+
+//Releases what a client that went away left pressed, except keys and
+//buttons another client holds as well.
+void Injector::releaseHeld(const InputEvent& event)
+{
+    const QHash<quint32, HeldKeys>::iterator held = heldKeys_.find(event.client);
+    if (held == heldKeys_.end())
+    {
+        return;
+    }
+    HeldKeys keys = held.value();
+    heldKeys_.erase(held);
+    for (const HeldKeys& other : heldKeys_)
+    {
+        keys.keyCodes &= ~other.keyCodes;
+        keys.buttons &= ~other.buttons;
+    }
+    if (keys.keyCodes.none() && keys.buttons.none())
+    {
+        return;
+    }
+    const qint64 injectStart = Stats::now();
+    int count = 0;
+    for (unsigned keyCode = 0; keyCode < keys.keyCodes.size(); ++keyCode)
+    {
+        if (keys.keyCodes.test(keyCode) && keyDown_[keyCode])
+        {
+            fakeKey(keyCode, false);
+            ++count;
+        }
+    }
+    for (unsigned button = 0; button < keys.buttons.size(); ++button)
+    {
+        if (keys.buttons.test(button))
+        {
+            backend_->fakeButton(button, false);
+            ++count;
+        }
+    }
+    stats_->record(Stats::INJECT, Stats::now() - injectStart);
+    LOG_INFO("Injector: released keys of a closed client", Log::field("client", event.client),
+             Log::field("released", count));
+    released_.fetch_add(count, std::memory_order_relaxed);
+    addPending(event.receivedAt, 1);
+}
+
+//Counts events for the flush. Events from the same read share one entry.
+void Injector::addPending(qint64 receivedAt, int events)
+{
+    if (!pendingEvents_.isEmpty() && pendingEvents_.last().first == receivedAt)
+    {
+        pendingEvents_.last().second += events;
+    }
+    else
+    {
+        pendingEvents_.append(qMakePair(receivedAt, events));
+    }
+}
+
+//Until the flush, oldest and newest hold receive times.
+void Injector::addAck(const InputEvent& event)
+{
+    if (event.ackClient == 0)
+    {
+        return;
+    }
+    if (!pendingAcks_.isEmpty() && pendingAcks_.last().client == event.ackClient)
+    {
+        Ack& ack = pendingAcks_.last();
+        ack.sequence = event.sequence;
+        ++ack.events;
+        ack.newest = event.receivedAt;
+        return;
+    }
+    const Ack ack = { event.ackClient, event.sequence, 1, event.receivedAt, event.receivedAt };
+    pendingAcks_.append(ack);
+}
+
+void Injector::flush()
+{
+    if (pendingEvents_.isEmpty())
+    {
+        return;
+    }
+    const qint64 flushStart = Stats::now();
+    backend_->flush();
+    const qint64 flushed = Stats::now();
+    stats_->record(Stats::FLUSH, flushed - flushStart);
+    for (const QPair<qint64, int>& events : pendingEvents_)
+    {
+        stats_->record(Stats::END_TO_END, flushed - events.first, events.second);
+    }
+    pendingEvents_.resize(0);
+    if (pendingAcks_.isEmpty())
+    {
+        return;
+    }
+    for (Ack& ack : pendingAcks_)
+    {
+        ack.oldest = flushed - ack.oldest;
+        ack.newest = flushed - ack.newest;
+        //When the queue is full the ack is dropped; the next one covers its
+        //events, as acks are cumulative.
+        acks_.push(ack);
+    }
+    pendingAcks_.resize(0);
+    if (!ackNotified_.exchange(true))
+    {
+        const quint64 one = 1;
+        if (write(ackFd_, &one, sizeof(one)) < 0)
+        {
+            LOG_ERROR("Injector: ack notification failed");
+        }
+    }
+}
+
+//Keyboard mapping changes invalidate the keycode table, so it is rebuilt
+//from the new mapping.
+void Injector::processBackendEvents()
+{
+    if (backend_->processEvents())
+    {
+        backend_->loadKeyMap(keyMap_);
+        LOG_INFO("Injector: keyboard mapping changed, key table rebuilt.");
+    }
+}
+
+//Sleeps until events are committed, the display has something to read or
+//the timeout (nanoseconds, negative for none) expires.
+void Injector::waitForWork(qint64 timeout)
+{
+    sleeping_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!queue_.isEmpty() || stopping_)
+    {
+        sleeping_.store(false);
+        return;
+    }
+
+    pollfd fds[3];
+    fds[0].fd = wakeFd_;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = backend_ != NULL ? backend_->fd() : -1;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    fds[2].fd = timerFd_;
+    fds[2].events = POLLIN;
+    fds[2].revents = 0;
+    timespec timeoutSpec;
+    timeoutSpec.tv_sec = timeout / 1000000000;
+    timeoutSpec.tv_nsec = timeout % 1000000000;
+    const int ready = ppoll(fds, 3, timeout >= 0 ? &timeoutSpec : NULL, NULL);
+    sleeping_.store(false);
+    //A timeout, or a signal such as the SIGUSR1 of the stats dump. The run
+    //loop checks for work again either way.
+    if (ready <= 0)
+    {
+        return;
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+        quint64 value;
+        if (read(wakeFd_, &value, sizeof(value)) < 0)
+        {
+            LOG_ERROR("Injector: wake-up read failed");
+        }
+    }
+    //A lost connection may only report POLLHUP.
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+    {
+        processBackendEvents();
+    }
+    if (fds[2].revents & POLLIN)
+    {
+        //The timer is one-shot; the next one is armed by the run loop.
+        quint64 expirations;
+        if (read(timerFd_, &expirations, sizeof(expirations)) < 0)
+        {
+            LOG_ERROR("Injector: playout timer read failed");
+        }
+        timerArmedAt_ = 0;
+    }
+}
@@ -0,0 +1,204 @@
+#ifndef INJECTOR_H
+#define INJECTOR_H
+
+#include <QThread>
+#include <QVector>
+#include <QPair>
+#include <QHash>
+#include <atomic>
+#include <bitset>
+#include <functional>
+#include "inputevent.h"
+#include "spscqueue.h"
+#include "keymap.h"
+
+class Stats;
+class InjectionBackend;
+
+//Injection thread. It owns the injection backend and drains events pushed by
+//the network thread through a lock-free queue, so a slow X server does not
+//stall socket reads and a busy network does not delay injection. Events
+//drained together share one flush. Events with a playout time wait in a
+//jitter buffer until a timerfd fires at that time.
+//
+//Keys and buttons pressed are tracked per client, so a RELEASE_HELD event
+//releases what a client that went away left pressed.
+//
+//The thread attaches to the display itself, retrying with backoff until
+//the X server is up, and reattaches the same way when the connection is
+//lost. Events drained while detached are rejected.
+class Injector : public QThread
+{
+    Q_OBJECT
+public:
+    explicit Injector(Stats* stats, QObject* parent = 0);
+    ~Injector();
+
+    //Called in the injection thread after an event has been injected, or
+    //for pointer motion, merged into the pending motion.
+    typedef std::function<void(const InputEvent& event)> InjectHook;
+
+    //Events of one client flushed to the display, for its ACK frame.
+    struct Ack
+    {
+        quint32 client;
+        quint32 sequence; //of the last event
+        quint32 events;
+        qint64 oldest;    //receive to flush of the first event, nanoseconds
+        qint64 newest;    //receive to flush of the last event, nanoseconds
+    };
+
+    //Sets the display to attach to through the named backend (see
+    //InjectionBackend::create). An empty name means $DISPLAY. Returns false
+    //for an unknown backend. Must be called before start().
+    bool setDisplay(const QString& backend, const QString& name);
+    //Must be set before start().
+    void setInjectHook(const InjectHook& hook);
+    //Delays the flush so events arriving within the window share one flush.
+    //Zero flushes whenever the queue has been drained.
+    void setFlushWindow(const unsigned microseconds);
+    //Pointer motion is merged and injected at most once per tick. Other
+    //events inject the pending motion first, so they never overtake it.
+    void setMotionTick(const unsigned microseconds);
+    //Applied by the injection thread when it starts, see
+    //Realtime::enterThread(). cpu -1 and fifoPriority 0 leave the thread
+    //as it is. Must be called before start().
+    void setRealtime(int cpu, int fifoPriority, bool prefault);
+    //Timed events played ahead of time because the jitter buffer was full.
+    //Safe to call from any thread.
+    quint64 playedEarly() const;
+    //Keysyms bound to a spare keycode because the keyboard mapping lacked
+    //them. Safe to call from any thread.
+    quint64 remapped() const;
+    //Safe to call from any thread.
+    bool isAttached() const;
+    //Events dropped because the display was not attached.
+    quint64 rejected() const;
+    //Keys and buttons released for clients that went away while holding
+    //them. Safe to call from any thread.
+    quint64 released() const;
+
+    //Producer side, called from the network thread only.
+    inline bool push(const InputEvent& event)
+    {
+        return queue_.push(event);
+    }
+    //Wakes the injection thread after a batch of pushes.
+    void commit();
+
+    //Consumer side of the acks, network thread only. ackFd() becomes
+    //readable when acks are waiting; then call resetAckFd() and takeAck()
+    //until it returns false.
+    int ackFd() const;
+    void resetAckFd();
+    inline bool takeAck(Ack& ack)
+    {
+        return acks_.pop(ack);
+    }
+    //True while pushed events wait for the injection thread.
+    inline bool hasQueued() const
+    {
+        return !queue_.isEmpty();
+    }
+
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    static const int QUEUE_SIZE = 16 * 1024;
+    static const int MAX_SCHEDULED = 4096;
+    static const int ACK_QUEUE_SIZE = 1024;
+
+    //Event in the jitter buffer. order keeps events with the same playout
+    //time in arrival order.
+    struct Scheduled
+    {
+        qint64 playAt;
+        quint64 order;
+        InputEvent event;
+    };
+
+    Stats* stats_;
+    QString backendName_;
+    QByteArray displayName_;
+    //NULL while detached.
+    InjectionBackend* backend_;
+    std::atomic<bool> attached_;
+    std::atomic<quint64> rejected_;
+    InjectHook injectHook_;
+    KeyMap keyMap_;
+    SpscQueue<InputEvent> queue_;
+    int wakeFd_;
+    //Acks of events flushed since the last flush, at most one per client
+    //and run of events.
+    QVector<Ack> pendingAcks_;
+    SpscQueue<Ack> acks_;
+    int ackFd_;
+    std::atomic<bool> ackNotified_;
+    int timerFd_;
+    //Binary heap, earliest playout time first.
+    QVector<Scheduled> scheduled_;
+    quint64 scheduleOrder_;
+    qint64 timerArmedAt_;
+    std::atomic<quint64> playedEarly_;
+    std::atomic<quint64> remapped_;
+    std::atomic<quint64> released_;
+    std::atomic<bool> sleeping_;
+    std::atomic<bool> stopping_;
+    qint64 flushWindow_;
+    //Receive time and event count of events waiting for the flush.
+    QVector<QPair<qint64, int> > pendingEvents_;
+    //Keys down through this injector, so taps know which modifiers are held.
+    bool keyDown_[256];
+    //Keycodes and buttons a client has pressed and not released yet.
+    struct HeldKeys
+    {
+        std::bitset<256> keyCodes;
+        std::bitset<256> buttons;
+    };
+    QHash<quint32, HeldKeys> heldKeys_;
+    //Pointer motion not injected yet: a relative offset, or an absolute
+    //position once a POINTER_POSITION has been merged.
+    struct Motion
+    {
+        bool pending;
+        bool absolute;
+        int x;
+        int y;
+        qint64 receivedAt; //of the first merged event
+        int events;
+    };
+    Motion motion_;
+    qint64 motionTick_;
+    qint64 lastMotionAt_;
+    int cpu_;
+    int fifoPriority_;
+    bool prefault_;
+
+    int drain();
+    void inject(const InputEvent& event);
+    KeyMap::Entry lookup(const InputEvent& event) const;
+    KeyMap::Entry bindSpareKeyCode(const InputEvent& event, KeyMap::Entry entry);
+    void fakeKey(KeyCode keyCode, bool press);
+    void tap(const KeyMap::Entry& entry, bool exact);
+    void mergeMotion(const InputEvent& event);
+    void injectMotion();
+    void injectPointer(const InputEvent& event);
+    void setHeld(quint32 client, bool button, unsigned code, bool down);
+    void releaseHeld(const InputEvent& event);
+    void addPending(qint64 receivedAt, int events);
+    void addAck(const InputEvent& event);
+    void flush();
+    void processBackendEvents();
+    bool attach();
+    void detach();
+    void reject();
+    void waitForWork(qint64 timeout);
+    void schedule(const InputEvent& event);
+    void playDue(qint64 now);
+    void armTimer();
+};
+
+#endif // INJECTOR_H
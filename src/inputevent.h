@@ -0,0 +1,42 @@
+#ifndef INPUTEVENT_H
+#define INPUTEVENT_H
+
+#include <QtGlobal>
+
+//Event handed from the network side to the injection thread.
+struct InputEvent
+{
+    enum class Type: quint8
+    {
+        KEY_PRESS,
+        KEY_RELEASE,
+        TEXT,   //press and release of the key typing a character
+        CHORD,  //press and release of a key with modifiers
+        POINTER_MOTION,
+        POINTER_POSITION,
+        BUTTON_PRESS,
+        BUTTON_RELEASE,
+        SCROLL,
+        RELEASE_HELD //release of every key and button the client holds
+    };
+
+    Type type;
+    quint32 key;        //Qt::Key, Unicode character for TEXT, key combination for CHORD,
+                        //button or point (see Message::packPoint()) for pointer events
+    quint32 sequence;
+    qint64 receivedAt;  //Stats::now() when the bytes were read
+    qint64 playAt;      //Stats::now() to inject at, zero for at once
+    quint32 ackClient;  //Client to acknowledge the event to, zero for none
+    quint32 client;     //Client holding the keys and buttons pressed, zero for none
+
+    inline qint16 x() const
+    {
+        return static_cast<qint16>(key >> 16);
+    }
+    inline qint16 y() const
+    {
+        return static_cast<qint16>(key & 0xffff);
+    }
+};
+
+#endif // INPUTEVENT_H
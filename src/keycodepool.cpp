@@ -0,0 +1,129 @@
+#include "keycodepool.h"
+
+KeyCodePool::KeyCodePool() :
+    clock_(0)
+{
+    for (bool& owned : owned_)
+    {
+        owned = false;
+    }
+}
+
+void KeyCodePool::reset(const quint32* keySyms, int minKeyCode, int keyCodeCount, int keySymsPerKeyCode)
+{
+    QHash<int, Binding> previous;
+    for (const Binding& binding : bindings_)
+    {
+        previous.insert(binding.keyCode, binding);
+    }
+    bindings_.clear();
+    for (bool& owned : owned_)
+    {
+        owned = false;
+    }
+
+    for (int i = 0; keySyms != NULL && i < keyCodeCount; ++i)
+    {
+        const int keyCode = minKeyCode + i;
+        if (keyCode < 0 || keyCode > 255)
+        {
+            continue;
+        }
+        //Spare keycodes have no keysyms at all; ours have only the keysym
+        //they were bound to.
+        Binding binding = { static_cast<KeyCode>(keyCode), NoSymbol, 0 };
+        const Binding ours = previous.value(keyCode, binding);
+        bool spare = true;
+        for (int column = 0; column < keySymsPerKeyCode; ++column)
+        {
+            const quint32 keySym = keySyms[i * keySymsPerKeyCode + column];
+            if (keySym != NoSymbol && keySym != ours.keySym)
+            {
+                spare = false;
+                break;
+            }
+            if (keySym != NoSymbol)
+            {
+                binding = ours;
+            }
+        }
+        if (spare)
+        {
+            bindings_.append(binding);
+            owned_[keyCode] = true;
+        }
+    }
+    indexBindings();
+}
+
+void KeyCodePool::resetFake(KeyCode first, KeyCode last)
+{
+    bindings_.clear();
+    for (bool& owned : owned_)
+    {
+        owned = false;
+    }
+    for (int keyCode = first; keyCode <= last; ++keyCode)
+    {
+        const Binding binding = { static_cast<KeyCode>(keyCode), NoSymbol, 0 };
+        bindings_.append(binding);
+        owned_[keyCode] = true;
+    }
+    indexBindings();
+}
+
+//A miss scans the pool for the least recently used binding. The pool is at
+//most a couple of hundred keycodes and a miss costs a keyboard mapping
+//change anyway.
+KeyCode KeyCodePool::acquire(quint32 keySym, const bool* keyDown, bool& rebind)
+{
+    rebind = false;
+    const QHash<quint32, int>::const_iterator bound = byKeySym_.constFind(keySym);
+    if (bound != byKeySym_.constEnd())
+    {
+        Binding& binding = bindings_[bound.value()];
+        binding.lastUsed = ++clock_;
+        return binding.keyCode;
+    }
+
+    int oldest = -1;
+    for (int i = 0; i < bindings_.size(); ++i)
+    {
+        if (!keyDown[bindings_[i].keyCode]
+                && (oldest < 0 || bindings_[i].lastUsed < bindings_[oldest].lastUsed))
+        {
+            oldest = i;
+        }
+    }
+    if (oldest < 0)
+    {
+        return 0;
+    }
+    Binding& binding = bindings_[oldest];
+    if (binding.keySym != NoSymbol)
+    {
+        byKeySym_.remove(binding.keySym);
+    }
+    binding.keySym = keySym;
+    binding.lastUsed = ++clock_;
+    byKeySym_.insert(keySym, oldest);
+    rebind = true;
+    return binding.keyCode;
+}
+
+int KeyCodePool::size() const
+{
+    return bindings_.size();
+}
+
+void KeyCodePool::indexBindings()
+{
+    byKeySym_.clear();
+    for (int i = 0; i < bindings_.size(); ++i)
+    {
+        if (bindings_[i].keySym != NoSymbol)
+        {
+            byKeySym_.insert(bindings_[i].keySym, i);
+        }
+    }
+}
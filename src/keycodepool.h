@@ -0,0 +1,53 @@
+#ifndef KEYCODEPOOL_H
+#define KEYCODEPOOL_H
+
+#include <QVector>
+#include <QHash>
+#include <X11/Xlib.h>
+
+//Keycodes without keysyms, bound on demand to keysyms the keyboard mapping
+//lacks, such as arbitrary Unicode characters. Binding changes the keyboard
+//mapping, which every X client then reloads, so bindings are kept and
+//reused. When every spare keycode is bound, the least recently used
+//binding is replaced.
+class KeyCodePool
+{
+public:
+    KeyCodePool();
+
+    //Takes the keycodes without keysyms from a core keyboard mapping.
+    //Keycodes still holding a binding of the pool keep it.
+    void reset(const quint32* keySyms, int minKeyCode, int keyCodeCount, int keySymsPerKeyCode);
+    //Uses a fixed range of keycodes, for running without an X server.
+    void resetFake(KeyCode first, KeyCode last);
+
+    //Keycode bound to keySym, 0 when there is no spare keycode. rebind is
+    //set when the caller has to bind the keycode to keySym first, see
+    //InjectionBackend::remapKey(). Keycodes marked in keyDown are never
+    //taken from their keysym.
+    KeyCode acquire(quint32 keySym, const bool* keyDown, bool& rebind);
+
+    inline bool contains(KeyCode keyCode) const
+    {
+        return owned_[keyCode];
+    }
+    int size() const;
+
+private:
+    struct Binding
+    {
+        KeyCode keyCode;
+        quint32 keySym;    //NoSymbol while unbound
+        quint64 lastUsed;
+    };
+
+    QVector<Binding> bindings_;
+    //Index in bindings_ of each bound keysym.
+    QHash<quint32, int> byKeySym_;
+    bool owned_[256];
+    quint64 clock_;
+
+    void indexBindings();
+};
+
+#endif // KEYCODEPOOL_H
@@ -0,0 +1,72 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <qnamespace.h>
+#include <X11/Xlib.h>
+#include "keycodepool.h"
+
+//Flat lookup table from Qt::Key to a resolved X keycode. Qt keys are either
+//Latin-1 codes or live in the 0x01000000 range, so two arrays cover every key
+//QtKeyToXKeySym knows about and a lookup is a single array probe.
+class KeyMap
+{
+public:
+    struct Entry
+    {
+        quint32 keySym;
+        KeyCode keyCode;
+        unsigned char modifiers; //Modifier mask needed to reach keySym.
+    };
+
+    //Empty until build().
+    KeyMap();
+
+    //Resolves the keysym of every Qt key. Keysyms do not depend on the
+    //display, so this is done once, before the first rebuild().
+    void build();
+    //Resolves keycodes against a core keyboard mapping: keySymsPerKeyCode
+    //keysyms for each keycode starting from minKeyCode. Call again after
+    //MappingNotify. Keycodes without keysyms go to spareKeyCodes().
+    void rebuild(const quint32* keySyms, int minKeyCode, int keyCodeCount, int keySymsPerKeyCode);
+    //Gives every known keysym a synthetic keycode, for running without an
+    //X server.
+    void rebuildFake();
+
+    inline const Entry& find(Qt::Key key) const
+    {
+        const unsigned k = static_cast<unsigned>(key);
+        if (k < LATIN1_SIZE)
+        {
+            return latin1_[k];
+        }
+        if (k - SPECIAL_BASE < SPECIAL_SIZE)
+        {
+            return special_[k - SPECIAL_BASE];
+        }
+        return noEntry_;
+    }
+
+    //Entry typing a Unicode character. QtKeyToXKeySym maps letters to lower
+    //case keysyms, so upper case letters get ShiftMask added to modifiers.
+    //Characters without a Qt key have no keycode.
+    Entry findCharacter(quint32 character) const;
+
+    //Keysym typing a Unicode character exactly, case included.
+    static quint32 characterKeySym(quint32 character);
+    //Keysyms missing from the keyboard mapping are bound to these.
+    KeyCodePool& spareKeyCodes();
+
+    static KeySym QtKeyToXKeySym(Qt::Key key);
+
+private:
+    static const unsigned LATIN1_SIZE = 0x100;
+    static const unsigned SPECIAL_BASE = 0x01000000;
+    static const unsigned SPECIAL_SIZE = 0x2000;
+    static const Entry noEntry_;
+
+    Entry latin1_[LATIN1_SIZE];
+    Entry special_[SPECIAL_SIZE];
+    KeyCodePool spare_;
+};
+
+#endif // KEYMAP_H
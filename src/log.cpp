@@ -0,0 +1,212 @@
+#include "log.h"
+#include "stats.h"
+#include <QKeySequence>
+#include <QByteArray>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+std::atomic<int> Log::runtimeLevel_(static_cast<int>(Log::Level::INFO));
+
+namespace
+{
+    const char LEVEL_NAMES[] = { 'D', 'I', 'W', 'E' };
+
+    //Bounded multi-producer single-consumer ring buffer. Every slot carries
+    //a sequence number telling whether it is free for the producer of that
+    //lap or filled for the consumer, so producers never take a lock.
+    class Logger
+    {
+    public:
+        Logger() :
+            enqueuePos_(0),
+            dequeuePos_(0),
+            dropped_(0),
+            started_(Stats::now()),
+            stopping_(false)
+        {
+            for (size_t i = 0; i < SIZE; ++i)
+            {
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            thread_ = std::thread(&Logger::run, this);
+        }
+
+        ~Logger()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wakeUp_.notify_one();
+            thread_.join();
+        }
+
+        bool push(const Log::Record& record)
+        {
+            size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+            Slot* slot;
+            for (;;)
+            {
+                slot = &slots_[pos & MASK];
+                const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+                if (diff == 0)
+                {
+                    if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    pos = enqueuePos_.load(std::memory_order_relaxed);
+                }
+            }
+            slot->record = record;
+            slot->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        void flush()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            drain();
+        }
+
+    private:
+        static const size_t SIZE = 1024;
+        static const size_t MASK = SIZE - 1;
+
+        struct Slot
+        {
+            Slot() : sequence(0) {}
+            std::atomic<size_t> sequence;
+            Log::Record record;
+        };
+
+        Slot slots_[SIZE];
+        std::atomic<size_t> enqueuePos_;
+        size_t dequeuePos_;
+        std::atomic<quint64> dropped_;
+        qint64 started_;
+        bool stopping_;
+        std::mutex mutex_;
+        std::condition_variable wakeUp_;
+        std::thread thread_;
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stopping_)
+            {
+                drain();
+                //Writers do not signal, so the buffer is polled.
+                wakeUp_.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            drain();
+        }
+
+        //Called with mutex_ held; only one thread consumes at a time.
+        void drain()
+        {
+            for (;;)
+            {
+                Slot& slot = slots_[dequeuePos_ & MASK];
+                const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePos_ + 1) < 0)
+                {
+                    break;
+                }
+                print(slot.record);
+                slot.sequence.store(dequeuePos_ + SIZE, std::memory_order_release);
+                ++dequeuePos_;
+            }
+            const quint64 dropped = dropped_.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0)
+            {
+                fprintf(stderr, "Log: %llu records dropped\n", static_cast<unsigned long long>(dropped));
+            }
+            fflush(stderr);
+        }
+
+        void print(const Log::Record& record)
+        {
+            const double seconds = (record.time - started_) / 1e9;
+            fprintf(stderr, "[%12.6f] %c %s", seconds, LEVEL_NAMES[static_cast<int>(record.level)], record.event);
+            if (record.text[0] != '\0')
+            {
+                fprintf(stderr, " %s", record.text);
+            }
+            for (int i = 0; i < record.fieldCount; ++i)
+            {
+                const Log::Field& field = record.fields[i];
+                switch (field.format)
+                {
+                    case Log::Format::DECIMAL:
+                        fprintf(stderr, " %s=%lld", field.name, static_cast<long long>(field.value));
+                        break;
+                    case Log::Format::HEX:
+                        fprintf(stderr, " %s=0x%llx", field.name, static_cast<unsigned long long>(field.value));
+                        break;
+                    case Log::Format::KEY:
+                        fprintf(stderr, " %s=%s", field.name,
+                                QKeySequence(static_cast<int>(field.value)).toString().toUtf8().constData());
+                        break;
+                }
+            }
+            fputc('\n', stderr);
+        }
+    };
+
+    Logger& logger()
+    {
+        static Logger instance;
+        return instance;
+    }
+}
+
+void Log::setLevel(Level level)
+{
+    runtimeLevel_.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+bool Log::setLevel(const QString& name)
+{
+    const char* const names[] = { "debug", "info", "warning", "error", "off" };
+    for (int i = 0; i <= static_cast<int>(Level::OFF); ++i)
+    {
+        if (name == names[i])
+        {
+            setLevel(static_cast<Level>(i));
+            return true;
+        }
+    }
+    return false;
+}
+
+void Log::flush()
+{
+    logger().flush();
+}
+
+void Log::setText(Record& record, const QString& text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    const int size = qMin(utf8.size(), MAX_TEXT - 1);
+    memcpy(record.text, utf8.constData(), size);
+    record.text[size] = '\0';
+}
+
+void Log::push(Record& record)
+{
+    record.time = Stats::now();
+    logger().push(record);
+}
@@ -0,0 +1,134 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <QString>
+#include <atomic>
+
+//Leveled structured logger. Writers only copy a fixed-size record into a
+//lock-free ring buffer; formatting and I/O happen in a background thread.
+//Event names and field names must be string literals.
+//
+//KAUKKIS_LOG_LEVEL removes lower levels at compile time, setLevel() filters
+//at run time. When the buffer is full records are dropped and counted.
+class Log
+{
+public:
+    enum class Level: int
+    {
+        DEBUG,
+        INFO,
+        WARNING,
+        ERROR,
+        OFF
+    };
+
+    enum class Format: quint8
+    {
+        DECIMAL,
+        HEX,
+        KEY //Qt::Key, printed as a key sequence
+    };
+
+    struct Field
+    {
+        const char* name;
+        qint64 value;
+        Format format;
+    };
+
+    static const int MAX_FIELDS = 4;
+    static const int MAX_TEXT = 64;
+
+    struct Record
+    {
+        qint64 time;
+        const char* event;
+        Level level;
+        quint8 fieldCount;
+        Field fields[MAX_FIELDS];
+        char text[MAX_TEXT];
+    };
+
+    static void setLevel(Level level);
+    static bool setLevel(const QString& name);
+
+    static inline bool enabled(Level level)
+    {
+        return static_cast<int>(level) >= runtimeLevel_.load(std::memory_order_relaxed);
+    }
+
+    static inline Field field(const char* name, qint64 value)
+    {
+        Field f = { name, value, Format::DECIMAL };
+        return f;
+    }
+
+    static inline Field hex(const char* name, qint64 value)
+    {
+        Field f = { name, value, Format::HEX };
+        return f;
+    }
+
+    static inline Field key(qint64 value)
+    {
+        Field f = { "key", value, Format::KEY };
+        return f;
+    }
+
+    template <typename... Args>
+    static inline void write(Level level, const char* event, const Args&... args)
+    {
+        Record record;
+        record.level = level;
+        record.event = event;
+        record.fieldCount = 0;
+        record.text[0] = '\0';
+        add(record, args...);
+        push(record);
+    }
+
+    //Writes out everything buffered so far.
+    static void flush();
+
+private:
+    static std::atomic<int> runtimeLevel_;
+
+    static inline void add(Record&) {}
+
+    template <typename... Args>
+    static inline void add(Record& record, const Field& field, const Args&... args)
+    {
+        if (record.fieldCount < MAX_FIELDS)
+        {
+            record.fields[record.fieldCount++] = field;
+        }
+        add(record, args...);
+    }
+
+    template <typename... Args>
+    static inline void add(Record& record, const QString& text, const Args&... args)
+    {
+        setText(record, text);
+        add(record, args...);
+    }
+
+    static void setText(Record& record, const QString& text);
+    static void push(Record& record);
+};
+
+#ifndef KAUKKIS_LOG_LEVEL
+#define KAUKKIS_LOG_LEVEL 1
+#endif
+
+#define KAUKKIS_LOG(level, ...) \
+    do { \
+        if (static_cast<int>(Log::Level::level) >= KAUKKIS_LOG_LEVEL && Log::enabled(Log::Level::level)) \
+            Log::write(Log::Level::level, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(...) KAUKKIS_LOG(DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) KAUKKIS_LOG(INFO, __VA_ARGS__)
+#define LOG_WARNING(...) KAUKKIS_LOG(WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) KAUKKIS_LOG(ERROR, __VA_ARGS__)
+
+#endif // LOG_H
@@ -1,6 +1,7 @@
 #include <QCoreApplication>
 #include <QCommandLineParser>
 #include "server.h"
+#include "log.h"
 
 int main(int argc, char *argv[])
 {
@@ -18,10 +19,155 @@ int main(int argc, char *argv[])
                                   + QString::number(DEFAULT_PORT), "port");
     portOption.setDefaultValue(QString::number(DEFAULT_PORT));
     parser.addOption(portOption);
+    QCommandLineOption flushWindowOption({"f","flush-window"}, "Coalesces key events arriving within "
+                                         "the given time into one flush. Default: 0", "microseconds");
+    flushWindowOption.setDefaultValue("0");
+    parser.addOption(flushWindowOption);
+    QCommandLineOption displayOption({"d","display"}, "Injects into the given X display. Repeat for "
+                                     "several displays, each gets its own injection thread; v2 clients "
+                                     "choose one in their hello, others use the first. Default: $DISPLAY",
+                                     "name");
+    parser.addOption(displayOption);
+    QCommandLineOption motionTickOption("motion-tick", "Merges pointer motion and injects it at most "
+                                        "once per tick. Default: 4000", "microseconds");
+    motionTickOption.setDefaultValue("4000");
+    parser.addOption(motionTickOption);
+    QCommandLineOption playoutDelayOption("playout-delay", "Replays timestamped events with their "
+                                          "original spacing after this delay, which should cover "
+                                          "the network jitter. 0 injects them at once. Default: 0",
+                                          "milliseconds");
+    playoutDelayOption.setDefaultValue("0");
+    parser.addOption(playoutDelayOption);
+    QCommandLineOption resumeTimeoutOption("resume-timeout", "Keeps the session of a disconnected "
+                                           "client this long for it to resume. 0 disables sessions. "
+                                           "Default: 30000", "milliseconds");
+    resumeTimeoutOption.setDefaultValue("30000");
+    parser.addOption(resumeTimeoutOption);
+    QCommandLineOption udpOption({"u","udp"}, "Also receives messages as UDP datagrams on the same port.");
+    parser.addOption(udpOption);
+    QCommandLineOption holdTimeoutOption("hold-timeout", "Releases a key held by a UDP client once its "
+                                         "press has not been repeated this long. Default: 500", "milliseconds");
+    holdTimeoutOption.setDefaultValue("500");
+    parser.addOption(holdTimeoutOption);
+    QCommandLineOption statsSocketOption("stats-socket", "Serves statistics on the given local socket. "
+                                         "SIGUSR1 always dumps them to the log.", "name");
+    parser.addOption(statsSocketOption);
+    QCommandLineOption logLevelOption({"l","log-level"}, "Sets log level: debug, info, warning, error "
+                                      "or off. Default: info", "level");
+    logLevelOption.setDefaultValue("info");
+    parser.addOption(logLevelOption);
+    QCommandLineOption backendOption({"b","backend"}, "Injects through xlib, xcb or null (no X server, "
+                                     "events are only counted). Default: xlib", "backend");
+    backendOption.setDefaultValue("xlib");
+    parser.addOption(backendOption);
+    QCommandLineOption overloadOption("overload", "What to do with a client that has queue-size events "
+                                      "waiting: block (stop reading it), drop (drop new presses) or "
+                                      "disconnect. Releases of held keys are never dropped. "
+                                      "Default: block", "policy");
+    overloadOption.setDefaultValue("block");
+    parser.addOption(overloadOption);
+    QCommandLineOption queueSizeOption("queue-size", "Events queued per client before it is overloaded. "
+                                       "Default: 1024", "events");
+    queueSizeOption.setDefaultValue("1024");
+    parser.addOption(queueSizeOption);
+    QCommandLineOption staleAfterOption("stale-after", "Drops press/release pairs that have waited this "
+                                        "long, 0 for never. Default: 200", "milliseconds");
+    staleAfterOption.setDefaultValue("200");
+    parser.addOption(staleAfterOption);
+    QCommandLineOption recordOption("record", "Records everything clients send to the file.", "file");
+    parser.addOption(recordOption);
+    QCommandLineOption replayOption("replay", "Replays a recording at its original speed instead of "
+                                    "listening, prints the statistics and exits.", "file");
+    parser.addOption(replayOption);
+    QCommandLineOption replayFastOption("replay-fast", "Replays as fast as the server injects.");
+    parser.addOption(replayFastOption);
+    QCommandLineOption lowLatencyOption("low-latency", "Sets TCP_NODELAY and TCP_QUICKACK on client "
+                                        "sockets and prefaults the buffers.");
+    parser.addOption(lowLatencyOption);
+    QCommandLineOption busyPollOption("busy-poll", "With --low-latency, busy polls client sockets "
+                                      "(SO_BUSY_POLL) this long. Default: 0", "microseconds");
+    busyPollOption.setDefaultValue("0");
+    parser.addOption(busyPollOption);
+    QCommandLineOption cpusOption("cpus", "Pins the network thread to the first CPU of the comma "
+                                  "separated list and the injection threads to the others.", "list");
+    parser.addOption(cpusOption);
+    QCommandLineOption fifoOption("fifo", "Runs the network and injection threads under SCHED_FIFO "
+                                  "with this priority and locks the memory. Default: 0 (off)",
+                                  "priority");
+    fifoOption.setDefaultValue("0");
+    parser.addOption(fifoOption);
     parser.process(a);
 
-    Server server;
+    if (!Log::setLevel(parser.value("log-level")))
+    {
+        qDebug() << "Unknown log level: " << parser.value("log-level");
+        return 1;
+    }
+
+    Server server(0, parser.value("backend"), parser.values("display"));
+    server.setFlushWindow(parser.value("flush-window").toUInt());
+    server.setMotionTick(parser.value("motion-tick").toUInt());
+    server.setPlayoutDelay(parser.value("playout-delay").toUInt());
+    server.setResumeTimeout(parser.value("resume-timeout").toUInt());
+    Realtime::Profile realtime;
+    realtime.lowLatency = parser.isSet(lowLatencyOption);
+    realtime.busyPoll = parser.value("busy-poll").toInt();
+    realtime.fifoPriority = parser.value("fifo").toInt();
+    if (parser.isSet(cpusOption))
+    {
+        for (const QString& cpu : parser.value("cpus").split(','))
+        {
+            bool ok = false;
+            realtime.cpus.append(cpu.toInt(&ok));
+            if (!ok || realtime.cpus.last() < 0)
+            {
+                qDebug() << "Invalid CPU: " << cpu;
+                return 1;
+            }
+        }
+    }
+    server.setRealtime(realtime);
+    bool queueSizeOk = false;
+    const int queueSize = parser.value("queue-size").toInt(&queueSizeOk);
+    if (!queueSizeOk || queueSize <= 0)
+    {
+        qDebug() << "Invalid queue size: " << parser.value("queue-size");
+        return 1;
+    }
+    if (!server.setOverloadPolicy(parser.value("overload"), queueSize,
+                                  parser.value("stale-after").toUInt()))
+    {
+        qDebug() << "Unknown overload policy: " << parser.value("overload");
+        return 1;
+    }
+    if (parser.isSet(replayOption))
+    {
+        if (!server.replay(parser.value("replay"), parser.isSet(replayFastOption)))
+        {
+            return 1;
+        }
+        QObject::connect(&server, SIGNAL(replayFinished()),
+                         &a, SLOT(quit()));
+        const int result = a.exec();
+        qDebug().noquote() << "Server: stats\n" + server.statsReport();
+        Log::flush();
+        return result;
+    }
+    if (parser.isSet(recordOption) && !server.record(parser.value("record")))
+    {
+        return 1;
+    }
     server.listen(parser.value("port").toUInt());
+    if (parser.isSet(statsSocketOption))
+    {
+        server.listenStats(parser.value("stats-socket"));
+    }
+    if (parser.isSet(udpOption))
+    {
+        server.listenUdp(parser.value("port").toUInt(), parser.value("hold-timeout").toUInt());
+    }
 
-    return a.exec();
+    const int result = a.exec();
+    Log::flush();
+    return result;
 }
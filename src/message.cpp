@@ -1,10 +1,21 @@
 #include "message.h"
 
+Message::Message() :
+    action_(0),
+    key_(0),
+    sequence_(0),
+    timed_(false),
+    timestamp_(0)
+{
+}
 
-Message::Message(Action action, Qt::Key key)
+Message::Message(Action action, Qt::Key key, quint32 sequence) :
+    action_(static_cast<qint8>(action)),
+    key_(static_cast<quint32>(key)),
+    sequence_(sequence),
+    timed_(false),
+    timestamp_(0)
 {
-    values_.first = static_cast<qint8>(action);
-    values_.second = static_cast<unsigned>(key);
 }
 
 Message::Message(QByteArray serializedMessage)
@@ -14,25 +25,53 @@ Message::Message(QByteArray serializedMessage)
 
 QByteArray Message::serialize() const
 {
-   QByteArray data;
-   QDataStream stream(&data, QIODevice::WriteOnly);
+    QByteArray data(SIZE, 0);
+    serialize(data.data());
+    return data;
+}
 
-   stream << values_;
-   return data;
+void Message::serialize(char* data) const
+{
+    data[0] = static_cast<char>(action_);
+    qToBigEndian<quint32>(key_, reinterpret_cast<uchar*>(data + 1));
 }
 
 void Message::deSerialize(QByteArray serializedMessage)
 {
-    QDataStream stream(&serializedMessage, QIODevice::ReadOnly);
-    stream >> values_;
+    if (serializedMessage.size() < SIZE)
+    {
+        serializedMessage.append(QByteArray(SIZE - serializedMessage.size(), 0));
+    }
+    deSerialize(serializedMessage.constData());
 }
 
 Message::Action Message::action() const
 {
-    return static_cast<Action>(values_.first);
+    return static_cast<Action>(action_);
 }
 
 Qt::Key Message::key() const
 {
-    return static_cast<Qt::Key>(values_.second);
+    return static_cast<Qt::Key>(key_);
+}
+
+quint32 Message::sequence() const
+{
+    return sequence_;
+}
+
+bool Message::isTimed() const
+{
+    return timed_;
+}
+
+quint32 Message::timestamp() const
+{
+    return timestamp_;
+}
+
+void Message::setTimestamp(quint32 timestamp)
+{
+    timed_ = true;
+    timestamp_ = timestamp;
 }
@@ -2,6 +2,7 @@
 #define MESSAGE_H
 #include <QtNetwork/QTcpSocket>
 #include <QByteArray>
+#include <QtEndian>
 
 using namespace std;
 
@@ -11,19 +12,66 @@ public:
     enum class Action: qint8
     {
         KEY_PRESS,
-        KEY_RELEASE
+        KEY_RELEASE,
+        //Types one Unicode character, given as the key. The server picks the
+        //key and presses Shift if the character needs it.
+        TEXT,
+        //Presses and releases a key with modifiers. The key is a Qt::Key
+        //or'ed with Qt::KeyboardModifiers, as in QKeySequence.
+        CHORD,
+        //Pointer events. Motion, position and scroll carry a point made with
+        //packPoint(); buttons carry the X button number (1 is the left one).
+        //Scrolling down and right is positive, one unit per wheel notch.
+        POINTER_MOTION,
+        POINTER_POSITION,
+        BUTTON_PRESS,
+        BUTTON_RELEASE,
+        SCROLL
     };
 
-    Message(Action action, Qt::Key key);
+    //Size of a frame on the wire. The format is the big-endian QDataStream
+    //encoding of QPair<qint8, unsigned>: one action byte and a 32-bit key.
+    static const int SIZE = 5;
+
+    Message();
+    Message(Action action, Qt::Key key, quint32 sequence = 0);
     Message(QByteArray serializedMessage);
     QByteArray serialize() const;
+    void serialize(char* data) const;
     void deSerialize(QByteArray serializedMessage);
 
+    //Decodes SIZE bytes in place.
+    inline void deSerialize(const char* data)
+    {
+        action_ = static_cast<qint8>(data[0]);
+        key_ = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data + 1));
+        sequence_ = 0;
+        timed_ = false;
+    }
+
+    //Packs two signed 16-bit coordinates into the key field.
+    static inline Qt::Key packPoint(int x, int y)
+    {
+        return static_cast<Qt::Key>((static_cast<quint32>(static_cast<quint16>(x)) << 16)
+                                    | static_cast<quint16>(y));
+    }
+
     Action action() const;
     Qt::Key key() const;
+    //Sequence number given by a v2 client. Legacy messages have zero.
+    quint32 sequence() const;
+    //Client clock in microseconds when the event happened, given in v2
+    //TIMED frames only. The clock may start anywhere and wrap around.
+    bool isTimed() const;
+    quint32 timestamp() const;
+    void setTimestamp(quint32 timestamp);
 
 private:
-    QPair<qint8, unsigned> values_;
+    qint8 action_;
+    quint32 key_;
+    quint32 sequence_;
+    bool timed_;
+    quint32 timestamp_;
 };
 
 #endif // MESSAGE_H
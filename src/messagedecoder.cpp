@@ -0,0 +1,382 @@
+#include "messagedecoder.h"
+#include "protocol.h"
+#include "realtime.h"
+#include <cstring>
+
+MessageDecoder::MessageDecoder(int capacity) :
+    buffer_(new char[capacity]),
+    capacity_(capacity),
+    begin_(0),
+    end_(0),
+    messages_(new Message[MAX_MESSAGES]),
+    mode_(Mode::DETECT),
+    helloPending_(false)
+{
+}
+
+MessageDecoder::~MessageDecoder()
+{
+    delete[] buffer_;
+    delete[] messages_;
+}
+
+char* MessageDecoder::writePointer()
+{
+    return buffer_ + end_;
+}
+
+int MessageDecoder::writeSpace() const
+{
+    return capacity_ - end_;
+}
+
+void MessageDecoder::commit(int bytes)
+{
+    end_ += bytes;
+}
+
+MessageDecoder::Mode MessageDecoder::mode() const
+{
+    return mode_;
+}
+
+bool MessageDecoder::takeHello()
+{
+    const bool pending = helloPending_;
+    helloPending_ = false;
+    return pending;
+}
+
+const QByteArray& MessageDecoder::helloPayload() const
+{
+    return helloPayload_;
+}
+
+void MessageDecoder::prefault()
+{
+    Realtime::prefault(buffer_, capacity_);
+    Realtime::prefault(messages_, MAX_MESSAGES * sizeof(Message));
+}
+
+MessageSpan MessageDecoder::decode()
+{
+    if (mode_ == Mode::DETECT && end_ > begin_)
+    {
+        if (buffer_[begin_] != Protocol::MAGIC[0])
+        {
+            mode_ = Mode::LEGACY;
+        }
+        else if (!decodeHello())
+        {
+            compact();
+            MessageSpan span = { messages_, 0, 0 };
+            return span;
+        }
+    }
+
+    int count = 0;
+    if (mode_ == Mode::LEGACY)
+    {
+        count = decodeLegacy();
+    }
+    else if (mode_ == Mode::V2)
+    {
+        count = decodeV2();
+    }
+    if (count == 0)
+    {
+        compact();
+    }
+    MessageSpan span = { messages_, count, 0 };
+    return span;
+}
+
+int MessageDecoder::decodeLegacy()
+{
+    int count = 0;
+    while (count < MAX_MESSAGES && end_ - begin_ >= Message::SIZE)
+    {
+        Message& msg = messages_[count];
+        msg.deSerialize(buffer_ + begin_);
+        begin_ += Message::SIZE;
+        //Legacy frames with an unknown action are skipped, as they always
+        //were, rather than closing the connection.
+        if (msg.action() >= Message::Action::KEY_PRESS && msg.action() <= Message::Action::SCROLL)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+//Returns false until the whole hello has arrived.
+bool MessageDecoder::decodeHello()
+{
+    if (end_ - begin_ < Protocol::HELLO_SIZE)
+    {
+        return false;
+    }
+    const char* hello = buffer_ + begin_;
+    const int payloadSize = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(hello + Protocol::MAGIC_SIZE + 1));
+    if (memcmp(hello, Protocol::MAGIC, Protocol::MAGIC_SIZE) != 0
+            || static_cast<quint8>(hello[Protocol::MAGIC_SIZE]) < Protocol::VERSION
+            || Protocol::HELLO_SIZE + payloadSize > capacity_)
+    {
+        mode_ = Mode::ERROR;
+        return false;
+    }
+    if (end_ - begin_ < Protocol::HELLO_SIZE + payloadSize)
+    {
+        return false;
+    }
+    helloPayload_ = QByteArray(hello + Protocol::HELLO_SIZE, payloadSize);
+    begin_ += Protocol::HELLO_SIZE + payloadSize;
+    mode_ = Mode::V2;
+    helloPending_ = true;
+    return true;
+}
+
+int MessageDecoder::decodeV2()
+{
+    int count = 0;
+    while (end_ - begin_ >= Protocol::FRAME_HEADER_SIZE)
+    {
+        const char* frame = buffer_ + begin_;
+        const int length = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(frame));
+        if (length < 1 || length + 2 > Protocol::MAX_FRAME_SIZE)
+        {
+            mode_ = Mode::ERROR;
+            break;
+        }
+        if (end_ - begin_ < length + 2)
+        {
+            break;
+        }
+        //Key events take at least two bytes and characters at least one, so
+        //this bounds the events of the frame. Leave the frame for the next
+        //call if it might not fit.
+        const Protocol::FrameType type = static_cast<Protocol::FrameType>(frame[2]);
+        if (count + (type == Protocol::FrameType::TEXT ? length : length / 2) > MAX_MESSAGES)
+        {
+            break;
+        }
+        const char* payload = frame + Protocol::FRAME_HEADER_SIZE;
+        const int payloadSize = length - 1;
+        const int frameStart = count;
+        switch (type)
+        {
+            case Protocol::FrameType::BATCH:
+                count = decodeBatch(payload, payloadSize, count);
+                break;
+            case Protocol::FrameType::TEXT:
+                count = decodeText(payload, payloadSize, count);
+                break;
+            case Protocol::FrameType::CHORD:
+                count = decodeChord(payload, payloadSize, count);
+                break;
+            case Protocol::FrameType::POINTER:
+                count = decodePointer(payload, payloadSize, count);
+                break;
+            case Protocol::FrameType::TIMED:
+                count = decodeTimed(payload, payloadSize, count);
+                break;
+            default:
+                //Unknown frame types are skipped for forward compatibility.
+                break;
+        }
+        if (mode_ == Mode::ERROR)
+        {
+            //A malformed frame is rejected as a whole, including the events
+            //decoded before the error.
+            count = frameStart;
+            break;
+        }
+        begin_ += length + 2;
+    }
+    return count;
+}
+
+int MessageDecoder::decodeBatch(const char* data, int size, int count)
+{
+    if (size < 4)
+    {
+        mode_ = Mode::ERROR;
+        return count;
+    }
+    quint32 sequence = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data));
+    const char* event = data + 4;
+    const char* end = data + size;
+    while (end - event >= 2)
+    {
+        const quint16 word = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(event));
+        const Message::Action action = word & Protocol::RELEASE_BIT ?
+                    Message::Action::KEY_RELEASE : Message::Action::KEY_PRESS;
+        quint32 key = word & Protocol::KEY_MASK;
+        event += 2;
+        if (word & Protocol::SPECIAL_BIT)
+        {
+            key += Protocol::SPECIAL_BASE;
+        }
+        else if (key == Protocol::EXTENDED_KEY)
+        {
+            if (end - event < 4)
+            {
+                mode_ = Mode::ERROR;
+                return count;
+            }
+            key = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(event));
+            event += 4;
+        }
+        messages_[count++] = Message(action, static_cast<Qt::Key>(key), sequence++);
+    }
+    if (event != end)
+    {
+        mode_ = Mode::ERROR;
+    }
+    return count;
+}
+
+//Decodes UTF-8 strictly: overlong forms, surrogates and truncated
+//characters are protocol errors.
+int MessageDecoder::decodeText(const char* data, int size, int count)
+{
+    if (size < 4)
+    {
+        mode_ = Mode::ERROR;
+        return count;
+    }
+    quint32 sequence = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data));
+    const uchar* byte = reinterpret_cast<const uchar*>(data + 4);
+    const uchar* end = reinterpret_cast<const uchar*>(data + size);
+    while (byte != end)
+    {
+        quint32 character = *byte++;
+        int continuation = 0;
+        quint32 minimum = 0;
+        if (character >= 0xf5)
+        {
+            mode_ = Mode::ERROR;
+            return count;
+        }
+        else if (character >= 0xf0)
+        {
+            continuation = 3;
+            minimum = 0x10000;
+            character &= 0x07;
+        }
+        else if (character >= 0xe0)
+        {
+            continuation = 2;
+            minimum = 0x800;
+            character &= 0x0f;
+        }
+        else if (character >= 0xc0)
+        {
+            continuation = 1;
+            minimum = 0x80;
+            character &= 0x1f;
+        }
+        else if (character >= 0x80)
+        {
+            mode_ = Mode::ERROR;
+            return count;
+        }
+        if (end - byte < continuation)
+        {
+            mode_ = Mode::ERROR;
+            return count;
+        }
+        for (int i = 0; i < continuation; ++i, ++byte)
+        {
+            if ((*byte & 0xc0) != 0x80)
+            {
+                mode_ = Mode::ERROR;
+                return count;
+            }
+            character = (character << 6) | (*byte & 0x3f);
+        }
+        if (character < minimum || character > 0x10ffff || (character >= 0xd800 && character < 0xe000))
+        {
+            mode_ = Mode::ERROR;
+            return count;
+        }
+        messages_[count++] = Message(Message::Action::TEXT, static_cast<Qt::Key>(character), sequence++);
+    }
+    return count;
+}
+
+int MessageDecoder::decodeChord(const char* data, int size, int count)
+{
+    if (size < 4 || size % 4 != 0)
+    {
+        mode_ = Mode::ERROR;
+        return count;
+    }
+    quint32 sequence = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data));
+    for (const char* chord = data + 4; chord != data + size; chord += 4)
+    {
+        const quint32 combination = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(chord));
+        messages_[count++] = Message(Message::Action::CHORD, static_cast<Qt::Key>(combination), sequence++);
+    }
+    return count;
+}
+
+int MessageDecoder::decodePointer(const char* data, int size, int count)
+{
+    if (size < 4 || (size - 4) % Message::SIZE != 0)
+    {
+        mode_ = Mode::ERROR;
+        return count;
+    }
+    quint32 sequence = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data));
+    for (const char* event = data + 4; event != data + size; event += Message::SIZE)
+    {
+        const Message::Action action = static_cast<Message::Action>(event[0]);
+        if (action < Message::Action::POINTER_MOTION || action > Message::Action::SCROLL)
+        {
+            mode_ = Mode::ERROR;
+            return count;
+        }
+        const quint32 value = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(event + 1));
+        messages_[count++] = Message(action, static_cast<Qt::Key>(value), sequence++);
+    }
+    return count;
+}
+
+int MessageDecoder::decodeTimed(const char* data, int size, int count)
+{
+    if (size < 4 || (size - 4) % Protocol::TIMED_EVENT_SIZE != 0)
+    {
+        mode_ = Mode::ERROR;
+        return count;
+    }
+    quint32 sequence = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data));
+    for (const char* event = data + 4; event != data + size; event += Protocol::TIMED_EVENT_SIZE)
+    {
+        const Message::Action action = static_cast<Message::Action>(event[4]);
+        if (action < Message::Action::KEY_PRESS || action > Message::Action::SCROLL)
+        {
+            mode_ = Mode::ERROR;
+            return count;
+        }
+        const quint32 value = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(event + 5));
+        messages_[count] = Message(action, static_cast<Qt::Key>(value), sequence++);
+        messages_[count++].setTimestamp(qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(event)));
+    }
+    return count;
+}
+
+//Moves the unconsumed bytes to the front to make room for the next read.
+void MessageDecoder::compact()
+{
+    if (begin_ == 0)
+    {
+        return;
+    }
+    end_ -= begin_;
+    if (end_ > 0)
+    {
+        memmove(buffer_, buffer_ + begin_, end_);
+    }
+    begin_ = 0;
+}
@@ -0,0 +1,81 @@
+#ifndef MESSAGEDECODER_H
+#define MESSAGEDECODER_H
+
+#include "message.h"
+
+//Read-only view of messages decoded by MessageDecoder. Valid until the next
+//call to MessageDecoder::decode().
+struct MessageSpan
+{
+    const Message* data;
+    int size;
+    qint64 receivedAt; //Stats::now() when the socket became readable.
+
+    const Message* begin() const { return data; }
+    const Message* end() const { return data + size; }
+};
+
+//Decodes frames in place from a per-connection receive buffer. Both the
+//buffer and the decoded messages are allocated once, so decoding does not
+//allocate per message. The protocol version is detected from the first
+//bytes the client sends (see protocol.h).
+class MessageDecoder
+{
+public:
+    enum class Mode
+    {
+        DETECT,
+        LEGACY,
+        V2,
+        ERROR
+    };
+
+    explicit MessageDecoder(int capacity = 64 * 1024);
+    ~MessageDecoder();
+
+    //Free space where the next read should be written to.
+    char* writePointer();
+    int writeSpace() const;
+    //Marks bytes written to writePointer() as received.
+    void commit(int bytes);
+
+    //Decodes complete frames. Returns an empty span when no complete frame
+    //is left; trailing partial frames are kept for the next read.
+    MessageSpan decode();
+
+    Mode mode() const;
+    //True once after a v2 hello has been received and must be answered.
+    //Messages decoded in the same call follow the hello.
+    bool takeHello();
+    //Options of the last hello, see Protocol::HelloOption.
+    const QByteArray& helloPayload() const;
+    //Touches the buffers so decoding does not fault pages in.
+    void prefault();
+
+    //Upper bound of the messages in one span.
+    static const int MAX_MESSAGES = 4096;
+
+private:
+    Q_DISABLE_COPY(MessageDecoder)
+
+    char* buffer_;
+    int capacity_;
+    int begin_;
+    int end_;
+    Message* messages_;
+    Mode mode_;
+    bool helloPending_;
+    QByteArray helloPayload_;
+
+    int decodeLegacy();
+    int decodeV2();
+    bool decodeHello();
+    int decodeBatch(const char* data, int size, int count);
+    int decodeText(const char* data, int size, int count);
+    int decodeChord(const char* data, int size, int count);
+    int decodePointer(const char* data, int size, int count);
+    int decodeTimed(const char* data, int size, int count);
+    void compact();
+};
+
+#endif // MESSAGEDECODER_H
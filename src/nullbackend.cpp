@@ -0,0 +1,87 @@
+#include "nullbackend.h"
+#include "keymap.h"
+
+NullBackend::NullBackend() :
+    events_(0),
+    flushes_(0)
+{
+    for (std::atomic<bool>& down : down_)
+    {
+        down.store(false, std::memory_order_relaxed);
+    }
+}
+
+bool NullBackend::open(const char*)
+{
+    return true;
+}
+
+void NullBackend::loadKeyMap(KeyMap& keyMap)
+{
+    keyMap.rebuildFake();
+}
+
+void NullBackend::fakeKey(KeyCode keyCode, bool press)
+{
+    down_[keyCode].store(press, std::memory_order_relaxed);
+    events_.store(events_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void NullBackend::remapKey(KeyCode, quint32)
+{
+}
+
+void NullBackend::fakeMotion(int, int)
+{
+    events_.store(events_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void NullBackend::fakePosition(int, int)
+{
+    events_.store(events_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void NullBackend::fakeButton(unsigned, bool)
+{
+    events_.store(events_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+unsigned NullBackend::buttonCount() const
+{
+    return 255;
+}
+
+void NullBackend::flush()
+{
+    flushes_.store(flushes_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+int NullBackend::fd() const
+{
+    return -1;
+}
+
+bool NullBackend::processEvents()
+{
+    return false;
+}
+
+bool NullBackend::failed() const
+{
+    return false;
+}
+
+quint64 NullBackend::events() const
+{
+    return events_.load(std::memory_order_relaxed);
+}
+
+quint64 NullBackend::flushes() const
+{
+    return flushes_.load(std::memory_order_relaxed);
+}
+
+bool NullBackend::isDown(KeyCode keyCode) const
+{
+    return down_[keyCode].load(std::memory_order_relaxed);
+}
@@ -0,0 +1,38 @@
+#ifndef NULLBACKEND_H
+#define NULLBACKEND_H
+
+#include "injectionbackend.h"
+#include <atomic>
+
+//Backend without an X server for benchmarks. Keycodes are synthetic and
+//events are only counted, together with which keys are currently down.
+class NullBackend : public InjectionBackend
+{
+public:
+    NullBackend();
+
+    bool open(const char* displayName) override;
+    void loadKeyMap(KeyMap& keyMap) override;
+    void fakeKey(KeyCode keyCode, bool press) override;
+    void remapKey(KeyCode keyCode, quint32 keySym) override;
+    void fakeMotion(int dx, int dy) override;
+    void fakePosition(int x, int y) override;
+    void fakeButton(unsigned button, bool press) override;
+    unsigned buttonCount() const override;
+    void flush() override;
+    int fd() const override;
+    bool processEvents() override;
+    bool failed() const override;
+
+    //Safe to read from any thread.
+    quint64 events() const;
+    quint64 flushes() const;
+    bool isDown(KeyCode keyCode) const;
+
+private:
+    std::atomic<quint64> events_;
+    std::atomic<quint64> flushes_;
+    std::atomic<bool> down_[256];
+};
+
+#endif // NULLBACKEND_H
@@ -0,0 +1,112 @@
+#include "playoutclock.h"
+#include <limits>
+
+PlayoutClock::PlayoutClock(qint64 delay) :
+    delay_(delay),
+    started_(false),
+    lastTimestamp_(0),
+    clientTime_(0),
+    windowStart_(0),
+    currentMin_(std::numeric_limits<qint64>::max()),
+    previousMin_(std::numeric_limits<qint64>::max()),
+    lastPlayAt_(0),
+    late_(0),
+    dropped_(0)
+{
+}
+
+qint64 PlayoutClock::playAt(quint32 timestamp, qint64 receivedAt)
+{
+    if (!started_)
+    {
+        started_ = true;
+        clientTime_ = timestamp;
+        windowStart_ = receivedAt;
+    }
+    else
+    {
+        clientTime_ += static_cast<qint32>(timestamp - lastTimestamp_);
+    }
+    lastTimestamp_ = timestamp;
+
+    if (receivedAt - windowStart_ > WINDOW)
+    {
+        previousMin_ = currentMin_;
+        currentMin_ = std::numeric_limits<qint64>::max();
+        windowStart_ = receivedAt;
+    }
+    const qint64 clientNanoseconds = clientTime_ * 1000;
+    currentMin_ = qMin(currentMin_, receivedAt - clientNanoseconds);
+    const qint64 playAt = clientNanoseconds + qMin(currentMin_, previousMin_) + delay_;
+    lastPlayAt_ = qMax(lastPlayAt_, playAt);
+    return lastPlayAt_;
+}
+
+bool PlayoutClock::admit(const InputEvent& event)
+{
+    bool press = false;
+    bool release = false;
+    quint32 key = event.key;
+    switch (event.type)
+    {
+        case InputEvent::Type::KEY_PRESS:
+            press = true;
+            break;
+        case InputEvent::Type::KEY_RELEASE:
+            release = true;
+            break;
+        case InputEvent::Type::BUTTON_PRESS:
+            press = true;
+            key |= BUTTON_BASE;
+            break;
+        case InputEvent::Type::BUTTON_RELEASE:
+            release = true;
+            key |= BUTTON_BASE;
+            break;
+        default:
+            break;
+    }
+    if (release && droppedKeys_.remove(key))
+    {
+        ++dropped_;
+        return false;
+    }
+
+    const qint64 lateness = event.receivedAt - event.playAt;
+    if (lateness <= 0)
+    {
+        return true;
+    }
+    ++late_;
+    if (lateness <= delay_)
+    {
+        return true;
+    }
+    if (press)
+    {
+        droppedKeys_.insert(key);
+        ++dropped_;
+        return false;
+    }
+    if (event.type == InputEvent::Type::POINTER_MOTION)
+    {
+        ++dropped_;
+        return false;
+    }
+    return true;
+}
+
+qint64 PlayoutClock::lastPlayAt() const
+{
+    return lastPlayAt_;
+}
+
+quint64 PlayoutClock::late() const
+{
+    return late_;
+}
+
+quint64 PlayoutClock::dropped() const
+{
+    return dropped_;
+}
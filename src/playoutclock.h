@@ -0,0 +1,50 @@
+#ifndef PLAYOUTCLOCK_H
+#define PLAYOUTCLOCK_H
+
+#include <QSet>
+#include "inputevent.h"
+
+//Maps the timestamps of one client to server time for the jitter buffer.
+//The offset between the clocks is the smallest one seen recently, that is
+//the one of the fastest delivery, so an event is played the playout delay
+//after it would have arrived without jitter. Tracking the minimum over a
+//sliding window follows clock drift.
+class PlayoutClock
+{
+public:
+    //delay is the playout delay in nanoseconds.
+    explicit PlayoutClock(qint64 delay);
+
+    //Server time (Stats::now()) to play an event at. Never earlier than the
+    //previous event, so events of the client keep their order.
+    qint64 playAt(quint32 timestamp, qint64 receivedAt);
+    //Checks an event that has its playAt set. Late events are played at
+    //once. Presses and motion later than another playout delay are dropped,
+    //and so is the release of a dropped press.
+    bool admit(const InputEvent& event);
+    //Playout time of the latest event, zero before the first one.
+    qint64 lastPlayAt() const;
+
+    quint64 late() const;
+    quint64 dropped() const;
+
+private:
+    //Window of the offset minimum in nanoseconds.
+    static const qint64 WINDOW = 10 * 1000000000LL;
+    static const quint32 BUTTON_BASE = 0x80000000;
+
+    qint64 delay_;
+    bool started_;
+    quint32 lastTimestamp_;
+    qint64 clientTime_; //Unwrapped timestamp in microseconds.
+    qint64 windowStart_;
+    qint64 currentMin_;
+    qint64 previousMin_;
+    qint64 lastPlayAt_;
+    //Keys and buttons whose press was dropped as too late.
+    QSet<quint32> droppedKeys_;
+    quint64 late_;
+    quint64 dropped_;
+};
+
+#endif // PLAYOUTCLOCK_H
@@ -0,0 +1,166 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QtEndian>
+#include "message.h"
+
+//Wire protocol v2.
+//
+//A v2 client starts with a hello: "KKS", version byte, 16-bit payload length
+//and payload. The payload is a list of options: option type byte, length
+//byte and value. Unknown options are ignored. Legacy clients start
+//directly with a Message frame whose first byte is a Message::Action, a
+//small number that is never the 'K' of the hello, so the first byte tells
+//the two apart. The server answers a hello with a hello carrying the
+//version it speaks and its answers to the options that have one.
+//
+//After the handshake every frame is: 16-bit length of the rest of the frame,
+//frame type byte and payload. All integers are big-endian.
+namespace Protocol
+{
+    const char MAGIC[] = { 'K', 'K', 'S' };
+    const int MAGIC_SIZE = 3;
+    const quint8 VERSION = 2;
+    const int HELLO_SIZE = MAGIC_SIZE + 1 + 2;
+    const int FRAME_HEADER_SIZE = 2 + 1;
+    //Upper bound of a whole frame, header included.
+    const int MAX_FRAME_SIZE = 4096;
+
+    enum class FrameType: quint8
+    {
+        //32-bit sequence number of the first event followed by compact key
+        //events. Event i of the batch has sequence number + i.
+        BATCH = 1,
+        //32-bit sequence number followed by UTF-8 text. Every character is
+        //one event typed with Message::Action::TEXT.
+        TEXT = 2,
+        //32-bit sequence number followed by 32-bit key combinations (Qt::Key
+        //or'ed with Qt::KeyboardModifiers), each typed as a Message::Action::CHORD.
+        CHORD = 3,
+        //32-bit sequence number followed by pointer events in Message format:
+        //action byte and 32-bit value.
+        POINTER = 4,
+        //32-bit sequence number followed by events with a timestamp: 32-bit
+        //client clock in microseconds, then action byte and 32-bit value as
+        //in Message. With a playout delay set, the server replays them with
+        //the same spacing they were sent with.
+        TIMED = 5,
+        //Server to client, only when asked for with HelloOption::ACKS:
+        //32-bit sequence number of the last event injected, 32-bit number of
+        //events injected since the previous ack, then the time from reading
+        //to flushing the oldest and the newest of them in 32-bit
+        //microseconds. Acks are cumulative and coalesced, so one ack may
+        //cover several batches. Pointer motion is not acknowledged.
+        ACK = 6
+    };
+
+    enum class HelloOption: quint8
+    {
+        //Name of the X display to inject into, as given to the server with
+        //--display. Without it the first display is used.
+        DISPLAY = 1,
+        //Asks for ACK frames. The value is ignored.
+        ACKS = 2,
+        //Empty to start a session, or the 64-bit token of a session to
+        //resume after a reconnect. A resumed session keeps its display, its
+        //queued events and its sequence numbers; a connection still open on
+        //it is closed. The server answers with the 64-bit token of the
+        //session, followed by the 32-bit sequence number of the last event
+        //it received when a session with events was resumed. The client
+        //then resends the events after that one; events it sends again
+        //anyway are dropped. A token other than the one asked for means the
+        //session expired. Keys held by a client are released when its
+        //connection closes, resumed or not.
+        SESSION = 3
+    };
+
+    //Compact key event: one 16-bit word. Latin-1 keys and keys in the
+    //0x01000000 range take no more space; other keys are escaped and
+    //followed by the full 32-bit key.
+    const quint16 RELEASE_BIT = 0x8000;
+    const quint16 SPECIAL_BIT = 0x4000;
+    const quint16 KEY_MASK = 0x3fff;
+    const quint16 EXTENDED_KEY = KEY_MASK;
+    const quint32 SPECIAL_BASE = 0x01000000;
+    const int MAX_KEY_EVENT_SIZE = 2 + 4;
+    const int TIMED_EVENT_SIZE = 4 + Message::SIZE;
+    const int ACK_FRAME_SIZE = FRAME_HEADER_SIZE + 4 * 4;
+    const int SESSION_TOKEN_SIZE = 8;
+
+    //Writes one compact key event and returns the number of bytes written.
+    inline int encodeKeyEvent(Message::Action action, Qt::Key key, char* data)
+    {
+        const quint32 k = static_cast<quint32>(key);
+        quint16 word = action == Message::Action::KEY_RELEASE ? RELEASE_BIT : 0;
+        if (k < EXTENDED_KEY)
+        {
+            word |= k;
+        }
+        else if (k - SPECIAL_BASE < EXTENDED_KEY)
+        {
+            word |= SPECIAL_BIT | (k - SPECIAL_BASE);
+        }
+        else
+        {
+            qToBigEndian<quint16>(word | EXTENDED_KEY, reinterpret_cast<uchar*>(data));
+            qToBigEndian<quint32>(k, reinterpret_cast<uchar*>(data + 2));
+            return 6;
+        }
+        qToBigEndian<quint16>(word, reinterpret_cast<uchar*>(data));
+        return 2;
+    }
+
+    //Writes an ACK frame of ACK_FRAME_SIZE bytes.
+    inline void encodeAck(char* frame, quint32 sequence, quint32 events, quint32 oldest, quint32 newest)
+    {
+        uchar* data = reinterpret_cast<uchar*>(frame);
+        qToBigEndian<quint16>(ACK_FRAME_SIZE - 2, data);
+        data[2] = static_cast<uchar>(FrameType::ACK);
+        qToBigEndian<quint32>(sequence, data + FRAME_HEADER_SIZE);
+        qToBigEndian<quint32>(events, data + FRAME_HEADER_SIZE + 4);
+        qToBigEndian<quint32>(oldest, data + FRAME_HEADER_SIZE + 8);
+        qToBigEndian<quint32>(newest, data + FRAME_HEADER_SIZE + 12);
+    }
+
+    inline QByteArray hello(quint8 version = VERSION, const QByteArray& payload = QByteArray())
+    {
+        QByteArray data(MAGIC, MAGIC_SIZE);
+        data.append(static_cast<char>(version));
+        data.append(static_cast<char>(payload.size() >> 8));
+        data.append(static_cast<char>(payload.size() & 0xff));
+        data.append(payload);
+        return data;
+    }
+
+    inline void appendHelloOption(QByteArray& payload, HelloOption option, const QByteArray& value)
+    {
+        payload.append(static_cast<char>(option));
+        payload.append(static_cast<char>(qMin(value.size(), 255)));
+        payload.append(value.left(255));
+    }
+
+    //Finds an option in a hello payload. Returns false if it is missing or
+    //the payload is malformed.
+    inline bool helloOption(const QByteArray& payload, HelloOption option, QByteArray& value)
+    {
+        int i = 0;
+        while (i + 2 <= payload.size())
+        {
+            const int length = static_cast<quint8>(payload[i + 1]);
+            if (i + 2 + length > payload.size())
+            {
+                return false;
+            }
+            if (static_cast<HelloOption>(payload[i]) == option)
+            {
+                value = payload.mid(i + 2, length);
+                return true;
+            }
+            i += 2 + length;
+        }
+        return false;
+    }
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,128 @@
+#include "realtime.h"
+#include "log.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+
+namespace
+{
+    const size_t PAGE_SIZE_FALLBACK = 4096;
+    //Stack the hot paths may use, see prefaultStack().
+    const size_t STACK_PREFAULT = 256 * 1024;
+
+    size_t pageSize()
+    {
+        const long size = sysconf(_SC_PAGESIZE);
+        return size > 0 ? static_cast<size_t>(size) : PAGE_SIZE_FALLBACK;
+    }
+}
+
+int Realtime::cpuFor(const Profile& profile, int thread)
+{
+    if (profile.cpus.isEmpty())
+    {
+        return -1;
+    }
+    if (thread == 0 || profile.cpus.size() == 1)
+    {
+        return profile.cpus.first();
+    }
+    return profile.cpus[1 + (thread - 1) % (profile.cpus.size() - 1)];
+}
+
+void Realtime::enterThread(const char* name, int cpu, int fifoPriority)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (error != 0)
+        {
+            LOG_WARNING("Realtime: unable to pin thread", QString(name) + ": " + strerror(error),
+                        Log::field("cpu", cpu));
+        }
+        else
+        {
+            LOG_INFO("Realtime: pinned thread", QString(name), Log::field("cpu", cpu));
+        }
+    }
+    if (fifoPriority > 0)
+    {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = fifoPriority;
+        const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error != 0)
+        {
+            //Typically EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO.
+            LOG_WARNING("Realtime: SCHED_FIFO unavailable, normal scheduling",
+                        QString(name) + ": " + strerror(error));
+        }
+        else
+        {
+            LOG_INFO("Realtime: SCHED_FIFO", QString(name), Log::field("priority", fifoPriority));
+        }
+    }
+}
+
+bool Realtime::lockMemory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        LOG_WARNING("Realtime: unable to lock memory", QString(strerror(errno)));
+        return false;
+    }
+    LOG_INFO("Realtime: memory locked");
+    return true;
+}
+
+void Realtime::prefault(void* data, size_t size)
+{
+    //Volatile, so the writes are not optimized away. Writing back what is
+    //there keeps the contents.
+    volatile char* bytes = static_cast<volatile char*>(data);
+    const size_t page = pageSize();
+    for (size_t offset = 0; offset < size; offset += page)
+    {
+        bytes[offset] = bytes[offset];
+    }
+    if (size > 0)
+    {
+        bytes[size - 1] = bytes[size - 1];
+    }
+}
+
+void Realtime::prefaultStack()
+{
+    volatile char stack[STACK_PREFAULT];
+    prefault(const_cast<char*>(stack), STACK_PREFAULT);
+}
+
+void Realtime::tuneSocket(int fd, int busyPoll)
+{
+    const int on = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0)
+    {
+        LOG_WARNING("Realtime: TCP_NODELAY failed", QString(strerror(errno)));
+    }
+    quickAck(fd);
+    if (busyPoll > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busyPoll, sizeof(busyPoll)) != 0)
+    {
+        //Values above net.core.busy_read need CAP_NET_ADMIN.
+        LOG_WARNING("Realtime: SO_BUSY_POLL failed", QString(strerror(errno)));
+    }
+}
+
+void Realtime::quickAck(int fd)
+{
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on));
+}
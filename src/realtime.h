@@ -0,0 +1,40 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <QList>
+#include <cstddef>
+
+//Low-latency profile of the server. Every step is best effort: when the
+//process lacks the privileges for one, a warning is logged and the server
+//runs as it would without it.
+namespace Realtime
+{
+    struct Profile
+    {
+        bool lowLatency;  //TCP_NODELAY and TCP_QUICKACK, prefaulted buffers
+        int busyPoll;     //SO_BUSY_POLL on client sockets in microseconds, 0 for off
+        QList<int> cpus;  //The first for the network thread, the rest shared by the injectors
+        int fifoPriority; //SCHED_FIFO priority, 0 for normal scheduling
+    };
+
+    //CPU of the network thread (thread 0) or of injector thread - 1. -1 for
+    //no pinning.
+    int cpuFor(const Profile& profile, int thread);
+    //Pins the calling thread and switches it to SCHED_FIFO as asked.
+    void enterThread(const char* name, int cpu, int fifoPriority);
+    //Locks current and future memory, so nothing the server touches is
+    //paged out.
+    bool lockMemory();
+    //Touches every page, so the first use of a buffer does not fault.
+    void prefault(void* data, size_t size);
+    //Prefaults the stack of the calling thread.
+    void prefaultStack();
+
+    //Client socket options set once after accepting.
+    void tuneSocket(int fd, int busyPoll);
+    //Linux clears TCP_QUICKACK as soon as it delays an ACK again, so it is
+    //set again after every read.
+    void quickAck(int fd);
+}
+
+#endif // REALTIME_H
@@ -0,0 +1,77 @@
+#include "recorder.h"
+#include "log.h"
+#include <QtEndian>
+#include <cstring>
+
+Recorder::Recorder(QObject* parent) :
+    QObject(parent),
+    buffer_(new char[BUFFER_SIZE]),
+    used_(0)
+{
+    flushTimer_.setInterval(1000);
+    connect(&flushTimer_, SIGNAL(timeout()),
+            this, SLOT(flush()));
+}
+
+Recorder::~Recorder()
+{
+    flush();
+    delete[] buffer_;
+}
+
+bool Recorder::open(const QString& fileName)
+{
+    file_.setFileName(fileName);
+    //Unbuffered: buffer_ already batches the writes.
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        return false;
+    }
+    memcpy(buffer_, Recording::MAGIC, Recording::MAGIC_SIZE);
+    used_ = Recording::MAGIC_SIZE;
+    flushTimer_.start();
+    return true;
+}
+
+void Recorder::append(quint32 stream, qint64 receivedAt, const char* data, int size)
+{
+    if (!file_.isOpen())
+    {
+        return;
+    }
+    //A read is at most the size of the decoder buffer, far below BUFFER_SIZE.
+    if (used_ + Recording::RECORD_HEADER_SIZE + size > BUFFER_SIZE)
+    {
+        flush();
+        if (!file_.isOpen())
+        {
+            return;
+        }
+    }
+    uchar* header = reinterpret_cast<uchar*>(buffer_ + used_);
+    qToBigEndian<quint64>(receivedAt, header);
+    qToBigEndian<quint32>(stream, header + 8);
+    qToBigEndian<quint32>(size, header + 12);
+    used_ += Recording::RECORD_HEADER_SIZE;
+    if (size > 0)
+    {
+        memcpy(buffer_ + used_, data, size);
+        used_ += size;
+    }
+}
+
+//A failed write stops the recording instead of leaving a gap in it.
+void Recorder::flush()
+{
+    if (used_ == 0 || !file_.isOpen())
+    {
+        return;
+    }
+    if (file_.write(buffer_, used_) != used_)
+    {
+        LOG_ERROR("Recorder: recording stopped", file_.errorString());
+        file_.close();
+        flushTimer_.stop();
+    }
+    used_ = 0;
+}
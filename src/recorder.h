@@ -0,0 +1,48 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+
+//Recording format of --record and --replay. All integers are big-endian.
+//
+//The file starts with the magic. Every read from a client socket is one
+//record: 64-bit receive time (Stats::now() nanoseconds), 32-bit stream
+//number (one per connection), 32-bit size and the bytes exactly as read. A
+//record of size zero closes its stream.
+namespace Recording
+{
+    const char MAGIC[] = { 'K', 'K', 'S', 'R', 'E', 'C', '1', '\n' };
+    const int MAGIC_SIZE = 8;
+    const int RECORD_HEADER_SIZE = 8 + 4 + 4;
+}
+
+//Writes what clients send to a recording. Reads are copied into a buffer
+//allocated once, so recording allocates nothing per read. The buffer is
+//written out when full and once a second.
+class Recorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Recorder(QObject* parent = 0);
+    ~Recorder();
+
+    //Truncates the file and writes the magic.
+    bool open(const QString& fileName);
+    //Records a read of a stream. A size of zero closes the stream.
+    void append(quint32 stream, qint64 receivedAt, const char* data, int size);
+
+public slots:
+    void flush();
+
+private:
+    static const int BUFFER_SIZE = 256 * 1024;
+
+    QFile file_;
+    char* buffer_;
+    int used_;
+    QTimer flushTimer_;
+};
+
+#endif // RECORDER_H
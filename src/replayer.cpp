@@ -0,0 +1,247 @@
+#include "replayer.h"
+#include "recorder.h"
+#include "server.h"
+#include "stats.h"
+#include "log.h"
+#include <QtEndian>
+#include <cstring>
+
+ReplayStream::ReplayStream(quint32 stream, const Server* server, QObject* parent) :
+    QObject(parent),
+    server_(server),
+    blocked_(false)
+{
+    setObjectName("replay stream " + QString::number(stream));
+}
+
+//Same as Connection::readMessages(): messages left in the decoder go
+//first, and nothing more is decoded while the server is full.
+int ReplayStream::feed(const char* data, int size, qint64 receivedAt)
+{
+    int taken = 0;
+    while (true)
+    {
+        if (!decode(receivedAt))
+        {
+            return -1;
+        }
+        if (blocked_ || taken == size)
+        {
+            return taken;
+        }
+        const int bytes = qMin(size - taken, decoder_.writeSpace());
+        memcpy(decoder_.writePointer(), data + taken, bytes);
+        decoder_.commit(bytes);
+        taken += bytes;
+    }
+}
+
+bool ReplayStream::isBlocked() const
+{
+    return blocked_;
+}
+
+//Emits decoded messages until the decoder runs dry or the server is full.
+//Returns false on a protocol error.
+bool ReplayStream::decode(qint64 receivedAt)
+{
+    blocked_ = false;
+    while (true)
+    {
+        if (server_->isFull(this))
+        {
+            blocked_ = true;
+            break;
+        }
+        MessageSpan messages = decoder_.decode();
+        if (decoder_.takeHello())
+        {
+            emit helloReceived(decoder_.helloPayload());
+        }
+        if (messages.size == 0)
+        {
+            break;
+        }
+        messages.receivedAt = receivedAt;
+        emit messagesReceived(messages);
+    }
+    return decoder_.mode() != MessageDecoder::Mode::ERROR;
+}
+
+Replayer::Replayer(Server* server, QObject* parent) :
+    QObject(parent),
+    server_(server),
+    map_(NULL),
+    size_(0),
+    position_(0),
+    recordOffset_(0),
+    fast_(false),
+    done_(false),
+    firstRecordAt_(0),
+    startedAt_(0),
+    records_(0),
+    bytes_(0)
+{
+    timer_.setSingleShot(true);
+    timer_.setTimerType(Qt::PreciseTimer);
+    connect(&timer_, SIGNAL(timeout()),
+            this, SLOT(feed()));
+}
+
+Replayer::~Replayer()
+{
+    if (map_ != NULL)
+    {
+        file_.unmap(const_cast<uchar*>(map_));
+    }
+}
+
+bool Replayer::open(const QString& fileName)
+{
+    file_.setFileName(fileName);
+    if (!file_.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    size_ = file_.size();
+    if (size_ < Recording::MAGIC_SIZE)
+    {
+        return false;
+    }
+    map_ = file_.map(0, size_);
+    if (map_ == NULL || memcmp(map_, Recording::MAGIC, Recording::MAGIC_SIZE) != 0)
+    {
+        return false;
+    }
+    position_ = Recording::MAGIC_SIZE;
+    if (size_ >= position_ + Recording::RECORD_HEADER_SIZE)
+    {
+        firstRecordAt_ = qFromBigEndian<quint64>(map_ + position_);
+    }
+    return true;
+}
+
+void Replayer::start(bool fast)
+{
+    fast_ = fast;
+    startedAt_ = Stats::now();
+    qDebug() << "Replayer: replaying " << file_.fileName() << (fast ? "as fast as possible" : "at original speed");
+    timer_.start(0);
+}
+
+//Feeds records until one is not due yet or its client queue is full, then
+//comes back when it is. A record is fed in parts if the queue fills up
+//before the whole record is decoded.
+void Replayer::feed()
+{
+    if (done_)
+    {
+        finish();
+        return;
+    }
+    for (int fed = 0; fed < FEED_QUANTUM; ++fed)
+    {
+        if (position_ == size_)
+        {
+            finish();
+            return;
+        }
+        const uchar* header = map_ + position_;
+        const qint64 remaining = size_ - position_ - Recording::RECORD_HEADER_SIZE;
+        const quint32 size = remaining < 0 ? 0 : qFromBigEndian<quint32>(header + 12);
+        if (remaining < 0 || size > remaining)
+        {
+            //The recording server did not exit cleanly.
+            LOG_WARNING("Replayer: recording ends in a partial record", file_.fileName());
+            finish();
+            return;
+        }
+        const qint64 recordedAt = qFromBigEndian<quint64>(header);
+        const quint32 stream = qFromBigEndian<quint32>(header + 8);
+
+        if (!fast_)
+        {
+            const qint64 wait = startedAt_ + (recordedAt - firstRecordAt_) - Stats::now();
+            if (wait > 0)
+            {
+                timer_.start(static_cast<int>((wait + 999999) / 1000000));
+                return;
+            }
+        }
+        ReplayStream*& replayStream = streams_[stream];
+        if (replayStream == NULL)
+        {
+            replayStream = new ReplayStream(stream, server_, this);
+            server_->addSource(replayStream);
+        }
+
+        const char* data = reinterpret_cast<const char*>(header + Recording::RECORD_HEADER_SIZE);
+        const int taken = replayStream->feed(data + recordOffset_, size - recordOffset_, Stats::now());
+        if (taken < 0)
+        {
+            LOG_WARNING("Replayer: protocol error in", replayStream->objectName());
+            nextRecord(size);
+            closeStream(stream);
+            continue;
+        }
+        recordOffset_ += taken;
+        //A close also waits until the stream has emitted what it holds.
+        if (recordOffset_ < size || (size == 0 && replayStream->isBlocked()))
+        {
+            timer_.start(1);
+            return;
+        }
+        nextRecord(size);
+        if (size == 0)
+        {
+            closeStream(stream);
+        }
+    }
+    timer_.start(0);
+}
+
+void Replayer::nextRecord(quint32 size)
+{
+    position_ += Recording::RECORD_HEADER_SIZE + size;
+    recordOffset_ = 0;
+    ++records_;
+    bytes_ += size;
+}
+
+void Replayer::closeStream(quint32 stream)
+{
+    ReplayStream* replayStream = streams_.take(stream);
+    server_->removeSource(replayStream);
+    replayStream->deleteLater();
+}
+
+//Waits until the server has handed every event to the injection threads.
+void Replayer::finish()
+{
+    if (!done_)
+    {
+        //Streams the recording did not close may still hold messages.
+        for (ReplayStream* replayStream : streams_)
+        {
+            if (replayStream->feed(NULL, 0, Stats::now()) >= 0 && replayStream->isBlocked())
+            {
+                timer_.start(1);
+                return;
+            }
+        }
+        done_ = true;
+        for (quint32 stream : streams_.keys())
+        {
+            closeStream(stream);
+        }
+    }
+    if (!server_->isIdle())
+    {
+        timer_.start(1);
+        return;
+    }
+    const qint64 elapsed = Stats::now() - startedAt_;
+    qDebug() << "Replayer: " << records_ << "reads," << bytes_ << "bytes in"
+             << elapsed / 1000000 << "ms";
+    emit finished();
+}
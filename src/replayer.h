@@ -0,0 +1,89 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QTimer>
+#include "messagedecoder.h"
+
+class Server;
+
+//One recorded connection. Decodes the recorded reads like Connection
+//decodes socket reads and emits the same signals. Like a paused
+//Connection, it stops emitting while the server has no room for it and
+//keeps what it has not emitted yet.
+class ReplayStream : public QObject
+{
+    Q_OBJECT
+public:
+    ReplayStream(quint32 stream, const Server* server, QObject* parent = 0);
+
+    //Takes bytes of a recorded read and returns how many were taken: fewer
+    //than size once the server is full, -1 on a protocol error. Feeding no
+    //bytes only emits what the decoder still holds.
+    int feed(const char* data, int size, qint64 receivedAt);
+    //Decoded messages wait for room in the server.
+    bool isBlocked() const;
+
+signals:
+    void messagesReceived(const MessageSpan& messages);
+    void helloReceived(const QByteArray& payload);
+
+private:
+    const Server* server_;
+    MessageDecoder decoder_;
+    bool blocked_;
+
+    bool decode(qint64 receivedAt);
+};
+
+//Feeds a recording made with --record to the server, without sockets, at
+//the original speed or as fast as the server takes the events. The file is
+//memory-mapped, so replaying copies nothing but the decoder input.
+//A server that cannot keep up holds the replay back instead of dropping
+//events, so replaying as fast as possible measures throughput on real
+//traffic.
+class Replayer : public QObject
+{
+    Q_OBJECT
+public:
+    Replayer(Server* server, QObject* parent = 0);
+    ~Replayer();
+
+    bool open(const QString& fileName);
+    void start(bool fast);
+
+signals:
+    //Every event has been handed to the injection threads.
+    void finished();
+
+private slots:
+    void feed();
+
+private:
+    //Records fed before returning to the event loop.
+    static const int FEED_QUANTUM = 64;
+
+    Server* server_;
+    QFile file_;
+    const uchar* map_;
+    qint64 size_;
+    qint64 position_;
+    //Bytes of the record at position_ already fed.
+    quint32 recordOffset_;
+    QHash<quint32, ReplayStream*> streams_;
+    bool fast_;
+    bool done_;
+    qint64 firstRecordAt_;
+    qint64 startedAt_;
+    quint64 records_;
+    quint64 bytes_;
+    QTimer timer_;
+
+    void nextRecord(quint32 size);
+    void closeStream(quint32 stream);
+    void finish();
+};
+
+#endif // REPLAYER_H
@@ -1,34 +1,137 @@
 #include "server.h"
+#include "connection.h"
 #include "message.h"
-#include <QKeySequence>
-#include <X11/keysym.h>
+#include "udpreceiver.h"
+#include "statsserver.h"
+#include "eventqueue.h"
+#include "playoutclock.h"
+#include "recorder.h"
+#include "replayer.h"
+#include "protocol.h"
+#include "log.h"
+#include <QSocketNotifier>
+#include <random>
 
-Server::Server(QObject* parent) :
+namespace
+{
+    //Events taken from one client queue before moving on to the next.
+    const int DRAIN_QUANTUM = 64;
+
+    //False for actions no decoder lets through.
+    bool eventType(Message::Action action, InputEvent::Type& type)
+    {
+        switch (action)
+        {
+            case Message::Action::KEY_PRESS:
+                type = InputEvent::Type::KEY_PRESS;
+                return true;
+            case Message::Action::KEY_RELEASE:
+                type = InputEvent::Type::KEY_RELEASE;
+                return true;
+            case Message::Action::TEXT:
+                type = InputEvent::Type::TEXT;
+                return true;
+            case Message::Action::CHORD:
+                type = InputEvent::Type::CHORD;
+                return true;
+            case Message::Action::POINTER_MOTION:
+                type = InputEvent::Type::POINTER_MOTION;
+                return true;
+            case Message::Action::POINTER_POSITION:
+                type = InputEvent::Type::POINTER_POSITION;
+                return true;
+            case Message::Action::BUTTON_PRESS:
+                type = InputEvent::Type::BUTTON_PRESS;
+                return true;
+            case Message::Action::BUTTON_RELEASE:
+                type = InputEvent::Type::BUTTON_RELEASE;
+                return true;
+            case Message::Action::SCROLL:
+                type = InputEvent::Type::SCROLL;
+                return true;
+        }
+        return false;
+    }
+}
+
+Server::Server(QObject* parent, const QString& backend, const QStringList& displays) :
     QObject(parent),
-    socket_(new QTcpSocket(this)),
-    //Finds out message size. It does not depend on message content.
-    messageSize_(Message(Message::Action::KEY_PRESS, Qt::Key_0).serialize().size()),
-    display_(XOpenDisplay(NULL))
+    statsServer_(new StatsServer(this, this)),
+    udpReceiver_(NULL),
+    overloadPolicy_(OverloadPolicy::BLOCK),
+    queueSize_(1024),
+    staleAfter_(200 * 1000000LL),
+    playoutDelay_(0),
+    recorder_(NULL),
+    nextStream_(0),
+    lastClient_(0),
+    resumeTimeout_(30 * 1000000000LL)
 {
-    if (display_ == NULL)
+    realtime_.lowLatency = false;
+    realtime_.busyPoll = 0;
+    realtime_.fifoPriority = 0;
+    const QStringList names = displays.isEmpty() ? QStringList(QString()) : displays;
+    for (const QString& name : names)
     {
-        qDebug() << "Server: Error: unable to open display!";
-        exit(1);
+        Target target;
+        target.name = name.isEmpty() ? QString::fromLocal8Bit(qgetenv("DISPLAY")) : name;
+        target.stats = new Stats(this);
+        target.injector = new Injector(target.stats, this);
+        //The injection thread attaches to the display, so the server listens
+        //before the X server is up.
+        if (!target.injector->setDisplay(backend, name))
+        {
+            qDebug() << "Server: Error: unknown injection backend " << backend;
+            exit(1);
+        }
+        qDebug() << "Server: display: " << target.name;
+        QSocketNotifier* ackNotifier = new QSocketNotifier(target.injector->ackFd(),
+                                                           QSocketNotifier::Read, this);
+        connect(ackNotifier, SIGNAL(activated(int)),
+                this, SLOT(sendAcks(int)));
+        targets_.append(target);
     }
-    qDebug() << "Server: message size: " << messageSize_;
     connect(&server_, SIGNAL(newConnection()),
             this, SLOT(newConnection()));
-
+    drainTimer_.setInterval(1);
+    connect(&drainTimer_, SIGNAL(timeout()),
+            this, SLOT(drainQueues()));
+    sessionTimer_.setInterval(1000);
+    connect(&sessionTimer_, SIGNAL(timeout()),
+            this, SLOT(expireSessions()));
 }
 
 Server::~Server()
 {
-    XFlush(display_);
-    XCloseDisplay(display_);
+    for (const Target& target : targets_)
+    {
+        target.injector->stop();
+    }
+    for (const Target& target : targets_)
+    {
+        target.injector->wait();
+    }
+    qDeleteAll(queues_);
+    qDeleteAll(clocks_);
+    for (const Session& session : sessions_)
+    {
+        delete session.clock;
+    }
+}
+
+int Server::displayCount() const
+{
+    return targets_.size();
+}
+
+Injector& Server::injector(int display)
+{
+    return *targets_[display].injector;
 }
 
 bool Server::listen(const unsigned port)
 {
+    startInjectors();
     if ( server_.listen(QHostAddress::Any, port) )
     {
         qDebug() << "Server: listening port: " << port;
@@ -38,403 +141,769 @@ bool Server::listen(const unsigned port)
     return false;
 }
 
-//Called when new connection appears
+bool Server::listenUdp(const unsigned port, const unsigned holdTimeout)
+{
+    if (udpReceiver_ == NULL)
+    {
+        udpReceiver_ = new UdpReceiver(&stats_, this);
+        connect(udpReceiver_, SIGNAL(peerAdded(UdpPeer*)),
+                this, SLOT(udpPeerAdded(UdpPeer*)));
+        connect(udpReceiver_, SIGNAL(peerRemoved(UdpPeer*)),
+                this, SLOT(udpPeerRemoved(UdpPeer*)));
+    }
+    udpReceiver_->setHoldTimeout(holdTimeout);
+    startInjectors();
+    return udpReceiver_->listen(port);
+}
+
+void Server::setFlushWindow(const unsigned microseconds)
+{
+    for (const Target& target : targets_)
+    {
+        target.injector->setFlushWindow(microseconds);
+    }
+    qDebug() << "Server: flush window: " << microseconds << "us";
+}
+
+void Server::setMotionTick(const unsigned microseconds)
+{
+    for (const Target& target : targets_)
+    {
+        target.injector->setMotionTick(microseconds);
+    }
+    qDebug() << "Server: motion tick: " << microseconds << "us";
+}
+
+void Server::setPlayoutDelay(const unsigned milliseconds)
+{
+    playoutDelay_ = static_cast<qint64>(milliseconds) * 1000000;
+    qDebug() << "Server: playout delay: " << milliseconds << "ms";
+}
+
+void Server::setResumeTimeout(const unsigned milliseconds)
+{
+    resumeTimeout_ = static_cast<qint64>(milliseconds) * 1000000;
+    qDebug() << "Server: resume timeout: " << milliseconds << "ms";
+}
+
+void Server::setRealtime(const Realtime::Profile& profile)
+{
+    realtime_ = profile;
+    //Locked before the threads start, so their stacks are locked as well.
+    if (profile.fifoPriority > 0)
+    {
+        Realtime::lockMemory();
+    }
+    Realtime::enterThread("network", Realtime::cpuFor(profile, 0), profile.fifoPriority);
+    if (profile.lowLatency)
+    {
+        Realtime::prefaultStack();
+    }
+    for (int i = 0; i < targets_.size(); ++i)
+    {
+        targets_[i].injector->setRealtime(Realtime::cpuFor(profile, i + 1), profile.fifoPriority,
+                                          profile.lowLatency);
+    }
+    QStringList cpus;
+    for (int cpu : profile.cpus)
+    {
+        cpus.append(QString::number(cpu));
+    }
+    qDebug() << "Server: low latency: " << profile.lowLatency << ", busy poll: " << profile.busyPoll
+             << "us, cpus: " << cpus.join(",") << ", fifo priority: " << profile.fifoPriority;
+}
+
+bool Server::setOverloadPolicy(const QString& policy, const int queueSize, const unsigned staleAfter)
+{
+    if (policy == "block")
+    {
+        overloadPolicy_ = OverloadPolicy::BLOCK;
+    }
+    else if (policy == "drop")
+    {
+        overloadPolicy_ = OverloadPolicy::DROP;
+    }
+    else if (policy == "disconnect")
+    {
+        overloadPolicy_ = OverloadPolicy::DISCONNECT;
+    }
+    else
+    {
+        return false;
+    }
+    queueSize_ = queueSize;
+    staleAfter_ = static_cast<qint64>(staleAfter) * 1000000;
+    qDebug() << "Server: overload policy: " << policy << ", queue size: " << queueSize
+             << ", stale after: " << staleAfter << "ms";
+    return true;
+}
+
+bool Server::record(const QString& fileName)
+{
+    if (recorder_ == NULL)
+    {
+        recorder_ = new Recorder(this);
+    }
+    if (!recorder_->open(fileName))
+    {
+        qDebug() << "Server: Error: unable to record to " << fileName;
+        return false;
+    }
+    qDebug() << "Server: recording to " << fileName;
+    return true;
+}
+
+bool Server::replay(const QString& fileName, bool fast)
+{
+    Replayer* replayer = new Replayer(this, this);
+    if (!replayer->open(fileName))
+    {
+        qDebug() << "Server: Error: " << fileName << " is not a recording";
+        delete replayer;
+        return false;
+    }
+    connect(replayer, SIGNAL(finished()),
+            this, SIGNAL(replayFinished()));
+    startInjectors();
+    replayer->start(fast);
+    return true;
+}
+
+//The queue takes one span past full, as the source checks isFull() between
+//spans.
+void Server::addSource(QObject* source)
+{
+    addQueue(source, 0, MessageDecoder::MAX_MESSAGES);
+    connectSource(source);
+}
+
+void Server::connectSource(QObject* source)
+{
+    connect(source, SIGNAL(messagesReceived(MessageSpan)),
+            this, SLOT(handleMessages(MessageSpan)));
+    connect(source, SIGNAL(helloReceived(QByteArray)),
+            this, SLOT(clientHello(QByteArray)));
+}
+
+//Events still queued are injected after the source is gone.
+void Server::removeSource(QObject* source)
+{
+    source->disconnect(this);
+    delete clocks_.take(source);
+    EventQueue* queue = sourceQueues_.take(source);
+    //Unless a session has taken it over.
+    if (queue != NULL)
+    {
+        retireQueue(queue);
+    }
+}
+
+bool Server::isFull(QObject* source) const
+{
+    const EventQueue* queue = sourceQueues_.value(source);
+    return queue != NULL && queue->isFull();
+}
+
+bool Server::isIdle() const
+{
+    for (const EventQueue* queue : queues_)
+    {
+        if (!queue->isEmpty())
+        {
+            return false;
+        }
+    }
+    for (const Target& target : targets_)
+    {
+        if (target.injector->hasQueued())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Server::listenStats(const QString& name)
+{
+    return statsServer_->listen(name);
+}
+
+QString Server::statsReport() const
+{
+    QString text = stats_.report();
+    text += "clients " + QString::number(connections_.size()) + "\n";
+    for (Connection* connection : connections_)
+    {
+        const EventQueue* queue = sourceQueues_.value(connection);
+        text += "client " + connection->peerName()
+                + " messages " + QString::number(connection->messageCount())
+                + " bytes " + QString::number(connection->byteCount())
+                + " display " + targets_[queue->target()].name
+                + " queued " + QString::number(queue->size())
+                + " collapsed " + QString::number(queue->collapsed())
+                + " stale " + QString::number(queue->stale())
+                + " overflow " + QString::number(queue->overflow());
+        const PlayoutClock* clock = clocks_.value(connection);
+        if (clock != NULL)
+        {
+            text += " late " + QString::number(clock->late())
+                    + " dropped_late " + QString::number(clock->dropped());
+        }
+        if (sessions_.contains(connection->session()))
+        {
+            text += " duplicates " + QString::number(sessions_.value(connection->session()).duplicates);
+        }
+        text += connection->isPaused() ? " paused\n" : "\n";
+    }
+    if (udpReceiver_ != NULL)
+    {
+        text += "udp_dropped " + QString::number(udpReceiver_->dropped()) + "\n";
+        for (UdpPeer* peer : udpReceiver_->peers())
+        {
+            const EventQueue* queue = sourceQueues_.value(peer);
+            text += "udp_client " + peer->peerName()
+                    + " display " + targets_[queue->target()].name
+                    + " queued " + QString::number(queue->size())
+                    + " collapsed " + QString::number(queue->collapsed())
+                    + " stale " + QString::number(queue->stale())
+                    + " overflow " + QString::number(queue->overflow()) + "\n";
+        }
+    }
+    for (const Target& target : targets_)
+    {
+        text += "display " + target.name
+                + (target.injector->isAttached() ? " attached" : " detached")
+                + " rejected " + QString::number(target.injector->rejected())
+                + " released " + QString::number(target.injector->released())
+                + " played_early " + QString::number(target.injector->playedEarly())
+                + " remapped " + QString::number(target.injector->remapped()) + "\n"
+                + target.stats->stagesReport();
+    }
+    return text;
+}
+
+//Called when new connections appear. Every pending client is accepted;
+//existing clients keep their connections.
 void Server::newConnection()
 {
-    qDebug() << "Server: newConnection() executed.";
-    socket_->disconnect(); //Exits loop
-    //Verifies that only one thread is reading the message.
-    newConnectionMutex_.lock();
-    delete socket_; //Remove old socket
-    //Grab the new connection
-    socket_ = server_.nextPendingConnection();
-    socket_->waitForConnected();
-    qDebug() << "Server: new connection from" << socket_->peerAddress().toString();
+    while (server_.hasPendingConnections())
+    {
+        QTcpSocket* socket = server_.nextPendingConnection();
+        Connection* connection = new Connection(socket, &stats_, this);
+        connection->setClient(++lastClient_);
+        if (realtime_.lowLatency)
+        {
+            Realtime::tuneSocket(socket->socketDescriptor(), realtime_.busyPoll);
+            connection->setLowLatency();
+        }
+        connections_.insert(connection);
+        //A blocked client is paused only after the span that filled its
+        //queue.
+        addQueue(connection, staleAfter_,
+                 overloadPolicy_ == OverloadPolicy::BLOCK ? MessageDecoder::MAX_MESSAGES : 0);
+        connectSource(connection);
+        connect(connection, SIGNAL(closed(Connection*)),
+                this, SLOT(connectionClosed(Connection*)));
+        if (recorder_ != NULL)
+        {
+            connection->setRecorder(recorder_, nextStream_++);
+        }
+        LOG_INFO("Server: new connection from", connection->peerName(),
+                 Log::field("clients", connections_.size()));
+    }
+}
+
+void Server::connectionClosed(Connection* connection)
+{
+    LOG_INFO("Server: Client disconnected", connection->peerName());
+    connections_.remove(connection);
+    //A resumed session may have handed the acks to a new connection.
+    if (ackClients_.value(connection->ackClient()) == connection)
+    {
+        ackClients_.remove(connection->ackClient());
+    }
+    releaseClient(connection);
+    removeSource(connection);
+    connection->deleteLater();
+    drainQueues();
+}
+
+//A UDP client gets a queue of its own, like a connection.
+void Server::udpPeerAdded(UdpPeer* peer)
+{
+    peer->setClient(++lastClient_);
+    addQueue(peer, staleAfter_, 0);
+    connect(peer, SIGNAL(messagesReceived(MessageSpan)),
+            this, SLOT(handleMessages(MessageSpan)));
+}
 
-    //Reads until client disconnects or new connection appears.
-    while (socket_->state() == QAbstractSocket::ConnectedState)
+void Server::udpPeerRemoved(UdpPeer* peer)
+{
+    LOG_INFO("Server: forgetting UDP client", peer->peerName());
+    queueRelease(peer, peer->client());
+    removeSource(peer);
+    drainQueues();
+}
+
+//Queues the release of whatever the client holds down behind its queued
+//events, so nothing stays pressed after it is gone.
+bool Server::queueRelease(QObject* source, quint32 client)
+{
+    EventQueue* queue = sourceQueues_.value(source);
+    if (queue == NULL)
     {
-        if (socket_->bytesAvailable() < messageSize_)
+        return false;
+    }
+    const PlayoutClock* clock = clocks_.value(source);
+    InputEvent release;
+    release.type = InputEvent::Type::RELEASE_HELD;
+    release.key = 0;
+    release.sequence = 0;
+    release.receivedAt = Stats::now();
+    //Not before the events of the client waiting in the jitter buffer.
+    release.playAt = clock != NULL ? clock->lastPlayAt() : 0;
+    release.ackClient = 0;
+    release.client = client;
+    queue->push(release, false);
+    return true;
+}
+
+//Releases what the closed connection holds down. A session keeps the queue
+//and clock of the client for a resume.
+void Server::releaseClient(Connection* connection)
+{
+    if (!queueRelease(connection, connection->client()))
+    {
+        //Released when a resumed session replaced it.
+        return;
+    }
+
+    const QHash<quint64, Session>::iterator session = sessions_.find(connection->session());
+    if (session == sessions_.end() || session->connection != connection)
+    {
+        return;
+    }
+    session->connection = NULL;
+    session->queue = sourceQueues_.take(connection);
+    session->clock = clocks_.take(connection);
+    session->closedAt = Stats::now();
+    if (!sessionTimer_.isActive())
+    {
+        sessionTimer_.start();
+    }
+}
+
+//Starts a session for the client, or resumes the one it asks for. A
+//connection still open on that session, typically one the client lost
+//without the server noticing, is closed.
+void Server::openSession(Connection* connection, const QByteArray& requested)
+{
+    const quint64 token = requested.size() == Protocol::SESSION_TOKEN_SIZE
+            ? qFromBigEndian<quint64>(requested.constData()) : 0;
+    const QHash<quint64, Session>::iterator session = token != 0 ? sessions_.find(token) : sessions_.end();
+    QByteArray reply(Protocol::SESSION_TOKEN_SIZE, '\0');
+    if (session == sessions_.end())
+    {
+        if (token != 0)
+        {
+            LOG_INFO("Server: client asked for an expired session", connection->peerName());
+        }
+        Session fresh;
+        fresh.client = connection->client();
+        fresh.connection = connection;
+        fresh.received = false;
+        fresh.lastSequence = 0;
+        fresh.duplicates = 0;
+        fresh.queue = NULL;
+        fresh.clock = NULL;
+        fresh.closedAt = 0;
+        const quint64 freshToken = newSessionToken();
+        sessions_.insert(freshToken, fresh);
+        connection->setSession(freshToken);
+        qToBigEndian<quint64>(freshToken, reply.data());
+    }
+    else
+    {
+        Connection* evicted = session->connection;
+        if (evicted != NULL)
+        {
+            connections_.remove(evicted);
+            releaseClient(evicted);
+        }
+        //The hello comes before any event of the connection, so the queue
+        //it was given is still empty.
+        EventQueue* unused = sourceQueues_.value(connection);
+        queues_.removeOne(unused);
+        delete unused;
+        sourceQueues_.insert(connection, session->queue);
+        if (session->clock != NULL)
+        {
+            clocks_.insert(connection, session->clock);
+        }
+        session->queue = NULL;
+        session->clock = NULL;
+        session->connection = connection;
+        connection->setClient(session->client);
+        connection->setSession(token);
+        qToBigEndian<quint64>(token, reply.data());
+        if (session->received)
         {
-            //Whole message has not been written.
-            socket_->waitForReadyRead();
-            continue; //Recheck if all bytes are written
+            char sequence[4];
+            qToBigEndian<quint32>(session->lastSequence, sequence);
+            reply.append(sequence, sizeof(sequence));
         }
+        LOG_INFO("Server: session resumed", connection->peerName(),
+                 Log::field("sequence", session->lastSequence));
+        if (evicted != NULL)
+        {
+            LOG_INFO("Server: closing connection of a resumed session", evicted->peerName());
+            evicted->abort();
+        }
+    }
+    QByteArray payload;
+    Protocol::appendHelloOption(payload, Protocol::HelloOption::SESSION, reply);
+    connection->setHelloReply(payload);
+}
 
-        //Deserialize the message
-        QByteArray serializedMessage = socket_->read(messageSize_);
-        Message msg(serializedMessage);
+quint64 Server::newSessionToken() const
+{
+    //Tokens are not guessable, so one client cannot take over the session
+    //of another.
+    std::random_device random;
+    quint64 token = 0;
+    while (token == 0 || sessions_.contains(token))
+    {
+        token = static_cast<quint64>(random()) << 32 | random();
+    }
+    return token;
+}
 
-        //Run given action.
-        unsigned keySym = QtKeyToXKeySym(msg.key());
-        switch (msg.action()) {
-            case Message::Action::KEY_PRESS:
-                qDebug().nospace() << "Server: Key Press called. Key=" << QKeySequence(msg.key()).toString();
-                pressKey(keySym);
-                break;
-            case Message::Action::KEY_RELEASE:
-                qDebug().nospace() << "Server: Key Release called. Key=" << QKeySequence(msg.key()).toString();
-                releaseKey(keySym);
-                break;
-        }
-    }
-    qDebug() << "Server: Client disconnected";
-    newConnectionMutex_.unlock();
-}
-
-void Server::pressKey(const unsigned keyCode)
-{
-    unsigned keycode = XKeysymToKeycode(display_, keyCode);
-    XTestFakeKeyEvent(display_, keycode, True, 0);
-    XFlush(display_);
-}
-
-void Server::releaseKey(const unsigned keyCode)
-{
-    unsigned keycode = XKeysymToKeycode(display_, keyCode);
-    XTestFakeKeyEvent(display_, keycode, false, 0);
-    XFlush(display_);
-}
-
-unsigned Server::QtKeyToXKeySym(Qt::Key key)
-{
-
-    // Convert the Qt key code into an X keysym.
-    KeySym keysym = NoSymbol;
-    switch (key) {
-        case Qt::Key_Escape: keysym = XK_Escape; break;
-        case Qt::Key_Tab: keysym = XK_Tab; break;
-        case Qt::Key_Backtab: keysym = XK_ISO_Left_Tab; break;
-        case Qt::Key_Backspace: keysym = XK_BackSpace; break;
-        case Qt::Key_Return: keysym = XK_Return; break;
-        case Qt::Key_Enter: keysym = XK_KP_Enter; break;
-        case Qt::Key_Insert: keysym = XK_KP_Insert; break;
-        case Qt::Key_Delete: keysym = XK_KP_Delete; break;
-        case Qt::Key_Pause: keysym = XK_Pause; break;
-        case Qt::Key_Print: keysym = XK_Print; break;
-        case Qt::Key_SysReq: keysym = 0x1005FF60; break;
-        case Qt::Key_Clear: keysym = XK_KP_Begin; break;
-        case Qt::Key_Home: keysym = XK_Home; break;
-        case Qt::Key_End: keysym = XK_End; break;
-        case Qt::Key_Left: keysym = XK_Left; break;
-        case Qt::Key_Up: keysym = XK_Up; break;
-        case Qt::Key_Right: keysym = XK_Right; break;
-        case Qt::Key_Down: keysym = XK_Down; break;
-        case Qt::Key_PageUp: keysym = XK_Prior; break;
-        case Qt::Key_PageDown: keysym = XK_Next; break;
-        case Qt::Key_Shift: keysym = XK_Shift_L; break;
-        case Qt::Key_Control: keysym = XK_Control_L; break;
-        case Qt::Key_Meta: keysym = XK_Meta_L; break;
-        case Qt::Key_Alt: keysym = XK_Alt_L; break;
-        case Qt::Key_CapsLock: keysym = XK_Caps_Lock; break;
-        case Qt::Key_NumLock: keysym = XK_Num_Lock; break;
-        case Qt::Key_ScrollLock: keysym = XK_Scroll_Lock; break;
-        case Qt::Key_F1: keysym = XK_F1; break;
-        case Qt::Key_F2: keysym = XK_F2; break;
-        case Qt::Key_F3: keysym = XK_F3; break;
-        case Qt::Key_F4: keysym = XK_F4; break;
-        case Qt::Key_F5: keysym = XK_F5; break;
-        case Qt::Key_F6: keysym = XK_F6; break;
-        case Qt::Key_F7: keysym = XK_F7; break;
-        case Qt::Key_F8: keysym = XK_F8; break;
-        case Qt::Key_F9: keysym = XK_F9; break;
-        case Qt::Key_F10: keysym = XK_F10; break;
-        case Qt::Key_F11: keysym = XK_F11; break;
-        case Qt::Key_F12: keysym = XK_F12; break;
-        case Qt::Key_F13: keysym = XK_F13; break;
-        case Qt::Key_F14: keysym = XK_F14; break;
-        case Qt::Key_F15: keysym = XK_F15; break;
-        case Qt::Key_F16: keysym = XK_F16; break;
-        case Qt::Key_F17: keysym = XK_F17; break;
-        case Qt::Key_F18: keysym = XK_F18; break;
-        case Qt::Key_F19: keysym = XK_F19; break;
-        case Qt::Key_F20: keysym = XK_F20; break;
-        case Qt::Key_F21: keysym = XK_F21; break;
-        case Qt::Key_F22: keysym = XK_F22; break;
-        case Qt::Key_F23: keysym = XK_F23; break;
-        case Qt::Key_F24: keysym = XK_F24; break;
-        case Qt::Key_F25: keysym = XK_F25; break;
-        case Qt::Key_F26: keysym = XK_F26; break;
-        case Qt::Key_F27: keysym = XK_F27; break;
-        case Qt::Key_F28: keysym = XK_F28; break;
-        case Qt::Key_F29: keysym = XK_F29; break;
-        case Qt::Key_F30: keysym = XK_F30; break;
-        case Qt::Key_F31: keysym = XK_F31; break;
-        case Qt::Key_F32: keysym = XK_F32; break;
-        case Qt::Key_F33: keysym = XK_F33; break;
-        case Qt::Key_F34: keysym = XK_F34; break;
-        case Qt::Key_F35: keysym = XK_F35; break;
-        case Qt::Key_Super_L: keysym = XK_Super_L; break;
-        case Qt::Key_Super_R: keysym = XK_Super_R; break;
-        case Qt::Key_Menu: keysym = XK_Menu; break;
-        case Qt::Key_Hyper_L: keysym = XK_Hyper_L; break;
-        case Qt::Key_Hyper_R: keysym = XK_Hyper_R; break;
-        case Qt::Key_Help: keysym = XK_Help; break;
-        case Qt::Key_Direction_L: keysym = NoSymbol; break; // ???
-        case Qt::Key_Direction_R: keysym = NoSymbol; break; // ???
-        case Qt::Key_Space: keysym = XK_space; break;
-        case Qt::Key_Exclam: keysym = XK_exclam; break;
-        case Qt::Key_QuoteDbl: keysym = XK_quotedbl; break;
-        case Qt::Key_NumberSign: keysym = XK_numbersign; break;
-        case Qt::Key_Dollar: keysym = XK_dollar; break;
-        case Qt::Key_Percent: keysym = XK_percent; break;
-        case Qt::Key_Ampersand: keysym = XK_ampersand; break;
-        case Qt::Key_Apostrophe: keysym = XK_apostrophe; break;
-        case Qt::Key_ParenLeft: keysym = XK_parenleft; break;
-        case Qt::Key_ParenRight: keysym = XK_parenright; break;
-        case Qt::Key_Asterisk: keysym = XK_asterisk; break;
-        case Qt::Key_Plus: keysym = XK_plus; break;
-        case Qt::Key_Comma: keysym = XK_comma; break;
-        case Qt::Key_Minus: keysym = XK_minus; break;
-        case Qt::Key_Period: keysym = XK_period; break;
-        case Qt::Key_Slash: keysym = XK_slash; break;
-        case Qt::Key_0: keysym = XK_0; break;
-        case Qt::Key_1: keysym = XK_1; break;
-        case Qt::Key_2: keysym = XK_2; break;
-        case Qt::Key_3: keysym = XK_3; break;
-        case Qt::Key_4: keysym = XK_4; break;
-        case Qt::Key_5: keysym = XK_5; break;
-        case Qt::Key_6: keysym = XK_6; break;
-        case Qt::Key_7: keysym = XK_7; break;
-        case Qt::Key_8: keysym = XK_8; break;
-        case Qt::Key_9: keysym = XK_9; break;
-        case Qt::Key_Colon: keysym = XK_colon; break;
-        case Qt::Key_Semicolon: keysym = XK_semicolon; break;
-        case Qt::Key_Less: keysym = XK_less; break;
-        case Qt::Key_Equal: keysym = XK_equal; break;
-        case Qt::Key_Greater: keysym = XK_greater; break;
-        case Qt::Key_Question: keysym = XK_question; break;
-        case Qt::Key_At: keysym = XK_at; break;
-        case Qt::Key_A: keysym = XK_a; break; // Must be lower case keysyms
-        case Qt::Key_B: keysym = XK_b; break; // for correct shift handling.
-        case Qt::Key_C: keysym = XK_c; break;
-        case Qt::Key_D: keysym = XK_d; break;
-        case Qt::Key_E: keysym = XK_e; break;
-        case Qt::Key_F: keysym = XK_f; break;
-        case Qt::Key_G: keysym = XK_g; break;
-        case Qt::Key_H: keysym = XK_h; break;
-        case Qt::Key_I: keysym = XK_i; break;
-        case Qt::Key_J: keysym = XK_j; break;
-        case Qt::Key_K: keysym = XK_k; break;
-        case Qt::Key_L: keysym = XK_l; break;
-        case Qt::Key_M: keysym = XK_m; break;
-        case Qt::Key_N: keysym = XK_n; break;
-        case Qt::Key_O: keysym = XK_o; break;
-        case Qt::Key_P: keysym = XK_p; break;
-        case Qt::Key_Q: keysym = XK_q; break;
-        case Qt::Key_R: keysym = XK_r; break;
-        case Qt::Key_S: keysym = XK_s; break;
-        case Qt::Key_T: keysym = XK_t; break;
-        case Qt::Key_U: keysym = XK_u; break;
-        case Qt::Key_V: keysym = XK_v; break;
-        case Qt::Key_W: keysym = XK_w; break;
-        case Qt::Key_X: keysym = XK_x; break;
-        case Qt::Key_Y: keysym = XK_y; break;
-        case Qt::Key_Z: keysym = XK_z; break;
-        case Qt::Key_BracketLeft: keysym = XK_bracketleft; break;
-        case Qt::Key_Backslash: keysym = XK_backslash; break;
-        case Qt::Key_BracketRight: keysym = XK_bracketright; break;
-        case Qt::Key_AsciiCircum: keysym = XK_asciicircum; break;
-        case Qt::Key_Underscore: keysym = XK_underscore; break;
-        case Qt::Key_QuoteLeft: keysym = XK_quoteleft; break;
-        case Qt::Key_BraceLeft: keysym = XK_braceleft; break;
-        case Qt::Key_Bar: keysym = XK_bar; break;
-        case Qt::Key_BraceRight: keysym = XK_braceright; break;
-        case Qt::Key_AsciiTilde: keysym = XK_asciitilde; break;
-
-        case Qt::Key_nobreakspace: keysym = XK_nobreakspace; break;
-        case Qt::Key_exclamdown: keysym = XK_exclamdown; break;
-        case Qt::Key_cent: keysym = XK_cent; break;
-        case Qt::Key_sterling: keysym = XK_sterling; break;
-        case Qt::Key_currency: keysym = XK_currency; break;
-        case Qt::Key_yen: keysym = XK_yen; break;
-        case Qt::Key_brokenbar: keysym = XK_brokenbar; break;
-        case Qt::Key_section: keysym = XK_section; break;
-        case Qt::Key_diaeresis: keysym = XK_diaeresis; break;
-        case Qt::Key_copyright: keysym = XK_copyright; break;
-        case Qt::Key_ordfeminine: keysym = XK_ordfeminine; break;
-        case Qt::Key_guillemotleft: keysym = XK_guillemotleft; break;
-        case Qt::Key_notsign: keysym = XK_notsign; break;
-        case Qt::Key_hyphen: keysym = XK_hyphen; break;
-        case Qt::Key_registered: keysym = XK_registered; break;
-        case Qt::Key_macron: keysym = XK_macron; break;
-        case Qt::Key_degree: keysym = XK_degree; break;
-        case Qt::Key_plusminus: keysym = XK_plusminus; break;
-        case Qt::Key_twosuperior: keysym = XK_twosuperior; break;
-        case Qt::Key_threesuperior: keysym = XK_threesuperior; break;
-        case Qt::Key_acute: keysym = XK_acute; break;
-        case Qt::Key_mu: keysym = XK_mu; break;
-        case Qt::Key_paragraph: keysym = XK_paragraph; break;
-        case Qt::Key_periodcentered: keysym = XK_periodcentered; break;
-        case Qt::Key_cedilla: keysym = XK_cedilla; break;
-        case Qt::Key_onesuperior: keysym = XK_onesuperior; break;
-        case Qt::Key_masculine: keysym = XK_masculine; break;
-        case Qt::Key_guillemotright: keysym = XK_guillemotright; break;
-        case Qt::Key_onequarter: keysym = XK_onequarter; break;
-        case Qt::Key_onehalf: keysym = XK_onehalf; break;
-        case Qt::Key_threequarters: keysym = XK_threequarters; break;
-        case Qt::Key_questiondown: keysym = XK_questiondown; break;
-        case Qt::Key_Agrave: keysym = XK_agrave; break;	// Lower case keysyms
-        case Qt::Key_Aacute: keysym = XK_aacute; break; // for shift handling.
-        case Qt::Key_Acircumflex: keysym = XK_acircumflex; break;
-        case Qt::Key_Atilde: keysym = XK_atilde; break;
-        case Qt::Key_Adiaeresis: keysym = XK_adiaeresis; break;
-        case Qt::Key_Aring: keysym = XK_aring; break;
-        case Qt::Key_AE: keysym = XK_ae; break;
-        case Qt::Key_Ccedilla: keysym = XK_ccedilla; break;
-        case Qt::Key_Egrave: keysym = XK_egrave; break;
-        case Qt::Key_Eacute: keysym = XK_eacute; break;
-        case Qt::Key_Ecircumflex: keysym = XK_ecircumflex; break;
-        case Qt::Key_Ediaeresis: keysym = XK_ediaeresis; break;
-        case Qt::Key_Igrave: keysym = XK_igrave; break;
-        case Qt::Key_Iacute: keysym = XK_iacute; break;
-        case Qt::Key_Icircumflex: keysym = XK_icircumflex; break;
-        case Qt::Key_Idiaeresis: keysym = XK_idiaeresis; break;
-        case Qt::Key_ETH: keysym = XK_eth; break;
-        case Qt::Key_Ntilde: keysym = XK_ntilde; break;
-        case Qt::Key_Ograve: keysym = XK_ograve; break;
-        case Qt::Key_Oacute: keysym = XK_oacute; break;
-        case Qt::Key_Ocircumflex: keysym = XK_ocircumflex; break;
-        case Qt::Key_Otilde: keysym = XK_otilde; break;
-        case Qt::Key_Odiaeresis: keysym = XK_odiaeresis; break;
-        case Qt::Key_multiply: keysym = XK_multiply; break;
-        case Qt::Key_Ooblique: keysym = XK_ooblique; break;
-        case Qt::Key_Ugrave: keysym = XK_ugrave; break;
-        case Qt::Key_Uacute: keysym = XK_uacute; break;
-        case Qt::Key_Ucircumflex: keysym = XK_ucircumflex; break;
-        case Qt::Key_Udiaeresis: keysym = XK_udiaeresis; break;
-        case Qt::Key_Yacute: keysym = XK_yacute; break;
-        case Qt::Key_THORN: keysym = XK_thorn; break;
-        case Qt::Key_ssharp: keysym = XK_ssharp; break;
-        case Qt::Key_division: keysym = XK_division; break;
-        case Qt::Key_ydiaeresis: keysym = XK_ydiaeresis; break;
-
-        case Qt::Key_AltGr: keysym = XK_ISO_Level3_Shift; break;
-        case Qt::Key_Multi_key: keysym = XK_Multi_key; break;
-        case Qt::Key_Codeinput: keysym = XK_Codeinput; break;
-        case Qt::Key_SingleCandidate: keysym = XK_SingleCandidate; break;
-        case Qt::Key_MultipleCandidate: keysym = XK_MultipleCandidate; break;
-        case Qt::Key_PreviousCandidate: keysym = XK_PreviousCandidate; break;
-
-        case Qt::Key_Mode_switch: keysym = XK_Mode_switch; break;
-        case Qt::Key_Kanji: keysym = XK_Kanji; break;
-        case Qt::Key_Muhenkan: keysym = XK_Muhenkan; break;
-        case Qt::Key_Henkan: keysym = XK_Henkan; break;
-        case Qt::Key_Romaji: keysym = XK_Romaji; break;
-        case Qt::Key_Hiragana: keysym = XK_Hiragana; break;
-        case Qt::Key_Katakana: keysym = XK_Katakana; break;
-        case Qt::Key_Hiragana_Katakana: keysym = XK_Hiragana_Katakana; break;
-        case Qt::Key_Zenkaku: keysym = XK_Zenkaku; break;
-        case Qt::Key_Hankaku: keysym = XK_Hankaku; break;
-        case Qt::Key_Zenkaku_Hankaku: keysym = XK_Zenkaku_Hankaku; break;
-        case Qt::Key_Touroku: keysym = XK_Touroku; break;
-        case Qt::Key_Massyo: keysym = XK_Massyo; break;
-        case Qt::Key_Kana_Lock: keysym = XK_Kana_Lock; break;
-        case Qt::Key_Kana_Shift: keysym = XK_Kana_Shift; break;
-        case Qt::Key_Eisu_Shift: keysym = XK_Eisu_Shift; break;
-        case Qt::Key_Eisu_toggle: keysym = XK_Eisu_toggle; break;
-
-        case Qt::Key_Hangul: keysym = XK_Hangul; break;
-        case Qt::Key_Hangul_Start: keysym = XK_Hangul_Start; break;
-        case Qt::Key_Hangul_End: keysym = XK_Hangul_End; break;
-        case Qt::Key_Hangul_Hanja: keysym = XK_Hangul_Hanja; break;
-        case Qt::Key_Hangul_Jamo: keysym = XK_Hangul_Jamo; break;
-        case Qt::Key_Hangul_Romaja: keysym = XK_Hangul_Romaja; break;
-        case Qt::Key_Hangul_Jeonja: keysym = XK_Hangul_Jeonja; break;
-        case Qt::Key_Hangul_Banja: keysym = XK_Hangul_Banja; break;
-        case Qt::Key_Hangul_PreHanja: keysym = XK_Hangul_PreHanja; break;
-        case Qt::Key_Hangul_PostHanja: keysym = XK_Hangul_PostHanja; break;
-        case Qt::Key_Hangul_Special: keysym = XK_Hangul_Special; break;
-
-        case Qt::Key_Dead_Grave: keysym = XK_dead_grave; break;
-        case Qt::Key_Dead_Acute: keysym = XK_dead_acute; break;
-        case Qt::Key_Dead_Circumflex: keysym = XK_dead_circumflex; break;
-        case Qt::Key_Dead_Tilde: keysym = XK_dead_tilde; break;
-        case Qt::Key_Dead_Macron: keysym = XK_dead_macron; break;
-        case Qt::Key_Dead_Breve: keysym = XK_dead_breve; break;
-        case Qt::Key_Dead_Abovedot: keysym = XK_dead_abovedot; break;
-        case Qt::Key_Dead_Diaeresis: keysym = XK_dead_diaeresis; break;
-        case Qt::Key_Dead_Abovering: keysym = XK_dead_abovering; break;
-        case Qt::Key_Dead_Doubleacute: keysym = XK_dead_doubleacute; break;
-        case Qt::Key_Dead_Caron: keysym = XK_dead_caron; break;
-        case Qt::Key_Dead_Cedilla: keysym = XK_dead_cedilla; break;
-        case Qt::Key_Dead_Ogonek: keysym = XK_dead_ogonek; break;
-        case Qt::Key_Dead_Iota: keysym = XK_dead_iota; break;
-        case Qt::Key_Dead_Voiced_Sound: keysym = XK_dead_voiced_sound; break;
-        case Qt::Key_Dead_Semivoiced_Sound: keysym = XK_dead_semivoiced_sound; break;
-        case Qt::Key_Dead_Belowdot: keysym = XK_dead_belowdot; break;
-        case Qt::Key_Dead_Hook: keysym = XK_dead_hook; break;
-        case Qt::Key_Dead_Horn: keysym = XK_dead_horn; break;
-        /*
-        case Qt::Key_Back: keysym = XF86XK_Back; break;
-        case Qt::Key_Forward: keysym = XF86XK_Forward; break;
-        case Qt::Key_Stop: keysym = XF86XK_Stop; break;
-        case Qt::Key_Refresh: keysym = XF86XK_Refresh; break;
-
-        case Qt::Key_VolumeDown: keysym = XF86XK_AudioLowerVolume; break;
-        case Qt::Key_VolumeMute: keysym = XF86XK_AudioMute; break;
-        case Qt::Key_VolumeUp: keysym = XF86XK_AudioRaiseVolume; break;
-        case Qt::Key_BassBoost: keysym = NoSymbol; break;	// ???
-        case Qt::Key_BassUp: keysym = NoSymbol; break;		// ???
-        case Qt::Key_BassDown: keysym = NoSymbol; break;	// ???
-        case Qt::Key_TrebleUp: keysym = NoSymbol; break;	// ???
-        case Qt::Key_TrebleDown: keysym = NoSymbol; break;	// ???
-
-        case Qt::Key_MediaPlay: keysym = XF86XK_AudioPlay; break;
-        case Qt::Key_MediaStop: keysym = XF86XK_AudioStop; break;
-        case Qt::Key_MediaPrevious: keysym = XF86XK_AudioPrev; break;
-        case Qt::Key_MediaNext: keysym = XF86XK_AudioNext; break;
-        case Qt::Key_MediaRecord: keysym = XF86XK_AudioRecord; break;
-
-        case Qt::Key_HomePage: keysym = XF86XK_HomePage; break;
-        case Qt::Key_Favorites: keysym = XF86XK_Favorites; break;
-        case Qt::Key_Search: keysym = XF86XK_Search; break;
-        case Qt::Key_Standby: keysym = XF86XK_Standby; break;
-        case Qt::Key_OpenUrl: keysym = XF86XK_OpenURL; break;
-
-        case Qt::Key_LaunchMail: keysym = XF86XK_Mail; break;
-        case Qt::Key_LaunchMedia: keysym = XF86XK_AudioMedia; break;
-        case Qt::Key_Launch0: keysym = XF86XK_Launch0; break;
-        case Qt::Key_Launch1: keysym = XF86XK_Launch1; break;
-        case Qt::Key_Launch2: keysym = XF86XK_Launch2; break;
-        case Qt::Key_Launch3: keysym = XF86XK_Launch3; break;
-        case Qt::Key_Launch4: keysym = XF86XK_Launch4; break;
-        case Qt::Key_Launch5: keysym = XF86XK_Launch5; break;
-        case Qt::Key_Launch6: keysym = XF86XK_Launch6; break;
-        case Qt::Key_Launch7: keysym = XF86XK_Launch7; break;
-        case Qt::Key_Launch8: keysym = XF86XK_Launch8; break;
-        case Qt::Key_Launch9: keysym = XF86XK_Launch9; break;
-        case Qt::Key_LaunchA: keysym = XF86XK_LaunchA; break;
-        case Qt::Key_LaunchB: keysym = XF86XK_LaunchB; break;
-        case Qt::Key_LaunchC: keysym = XF86XK_LaunchC; break;
-        case Qt::Key_LaunchD: keysym = XF86XK_LaunchD; break;
-        case Qt::Key_LaunchE: keysym = XF86XK_LaunchE; break;
-        case Qt::Key_LaunchF: keysym = XF86XK_LaunchF; break;
-
-        case Qt::Key_MediaLast: keysym = NoSymbol; break;   // ???
-
-        case Qt::Key_Select: keysym = QTOPIAXK_Select; break;
-        case Qt::Key_Yes: keysym = QTOPIAXK_Yes; break;
-        case Qt::Key_No: keysym = QTOPIAXK_No; break;
-
-        case Qt::Key_Cancel: keysym = QTOPIAXK_Cancel; break;
-        case Qt::Key_Printer: keysym = QTOPIAXK_Printer; break;
-        case Qt::Key_Execute: keysym = QTOPIAXK_Execute; break;
-        case Qt::Key_Sleep: keysym = QTOPIAXK_Sleep; break;
-        case Qt::Key_Play: keysym = QTOPIAXK_Play; break;
-        case Qt::Key_Zoom: keysym = QTOPIAXK_Zoom; break;
-
-        case Qt::Key_Context1: keysym = QTOPIAXK_Context1; break;
-        case Qt::Key_Context2: keysym = QTOPIAXK_Context2; break;
-        case Qt::Key_Context3: keysym = QTOPIAXK_Context3; break;
-        case Qt::Key_Context4: keysym = QTOPIAXK_Context4; break;
-        case Qt::Key_Call: keysym = QTOPIAXK_Call; break;
-        case Qt::Key_Hangup: keysym = QTOPIAXK_Hangup; break;
-        case Qt::Key_Flip: keysym = QTOPIAXK_Flip; break;
-        */
-        default:
-            qDebug() << "Server: Undetected key: " << QKeySequence(key).toString();
-            break;
-    }
-    return keysym;
+//Ends the sessions whose client did not come back in time. Their queues
+//are retired like those of closed clients.
+void Server::expireSessions()
+{
+    const qint64 deadline = Stats::now() - resumeTimeout_;
+    bool waiting = false;
+    for (QHash<quint64, Session>::iterator session = sessions_.begin(); session != sessions_.end();)
+    {
+        if (session->connection != NULL)
+        {
+            ++session;
+            continue;
+        }
+        if (session->closedAt > deadline)
+        {
+            waiting = true;
+            ++session;
+            continue;
+        }
+        LOG_DEBUG("Server: session expired", Log::field("client", session->client));
+        delete session->clock;
+        retireQueue(session->queue);
+        session = sessions_.erase(session);
+    }
+    if (!waiting)
+    {
+        sessionTimer_.stop();
+    }
+}
+
+//Queues every message of a read in the client's queue and hands as much as
+//fits to the injection thread.
+void Server::handleMessages(const MessageSpan& messages)
+{
+    EventQueue* queue = sourceQueues_.value(sender());
+    if (queue == NULL)
+    {
+        return;
+    }
+    Connection* connection = qobject_cast<Connection*>(sender());
+    UdpPeer* udpPeer = qobject_cast<UdpPeer*>(sender());
+    //Sources added with addSource() wait for room instead.
+    const bool dropWhenFull = udpPeer != NULL
+            || (connection != NULL && overloadPolicy_ == OverloadPolicy::DROP);
+    const quint32 ackClient = connection != NULL ? connection->ackClient() : 0;
+    quint32 client = 0;
+    if (connection != NULL)
+    {
+        client = connection->client();
+    }
+    else if (udpPeer != NULL)
+    {
+        client = udpPeer->client();
+    }
+    Session* session = NULL;
+    if (connection != NULL && connection->session() != 0)
+    {
+        const QHash<quint64, Session>::iterator found = sessions_.find(connection->session());
+        if (found != sessions_.end())
+        {
+            session = &found.value();
+        }
+    }
+    for (const Message& msg : messages)
+    {
+        if (session != NULL)
+        {
+            //Events a resuming client sends again.
+            if (session->received && static_cast<qint32>(msg.sequence() - session->lastSequence) <= 0)
+            {
+                ++session->duplicates;
+                continue;
+            }
+            session->received = true;
+            session->lastSequence = msg.sequence();
+        }
+        InputEvent event;
+        if (!eventType(msg.action(), event.type))
+        {
+            continue;
+        }
+        event.key = msg.key();
+        event.sequence = msg.sequence();
+        event.receivedAt = messages.receivedAt;
+        event.playAt = 0;
+        event.ackClient = ackClient;
+        event.client = client;
+        if (msg.isTimed() && playoutDelay_ > 0)
+        {
+            PlayoutClock*& clock = clocks_[sender()];
+            if (clock == NULL)
+            {
+                clock = new PlayoutClock(playoutDelay_);
+            }
+            event.playAt = clock->playAt(msg.timestamp(), event.receivedAt);
+            if (!clock->admit(event))
+            {
+                continue;
+            }
+        }
+        else
+        {
+            //Untimed events do not overtake the timed events of the client
+            //still waiting in the jitter buffer.
+            const PlayoutClock* clock = clocks_.value(sender());
+            if (clock != NULL)
+            {
+                event.playAt = clock->lastPlayAt();
+            }
+        }
+        queue->push(event, dropWhenFull);
+    }
+    drainQueues();
+
+    if (connection != NULL && queue->isFull())
+    {
+        if (overloadPolicy_ == OverloadPolicy::BLOCK)
+        {
+            LOG_DEBUG("Server: pausing", connection->peerName(), Log::field("queued", queue->size()));
+            connection->pause();
+        }
+        else if (overloadPolicy_ == OverloadPolicy::DISCONNECT)
+        {
+            LOG_WARNING("Server: disconnecting overloading client", connection->peerName());
+            connection->abort();
+        }
+    }
+}
+
+//Moves queued events to the injection queues, taking turns between clients
+//so one flooding client cannot starve the others. A full injection queue
+//only holds back the clients of its display. Paused clients resume
+//once their queue is half empty.
+void Server::drainQueues()
+{
+    const qint64 now = Stats::now();
+    for (EventQueue* queue : queues_)
+    {
+        queue->dropStale(now);
+    }
+
+    for (Target& target : targets_)
+    {
+        target.pushed = false;
+        target.full = false;
+    }
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        for (EventQueue* queue : queues_)
+        {
+            Target& target = targets_[queue->target()];
+            for (int i = 0; i < DRAIN_QUANTUM && !queue->isEmpty() && !target.full; ++i)
+            {
+                if (!target.injector->push(queue->front()))
+                {
+                    target.full = true;
+                    break;
+                }
+                queue->pop();
+                target.pushed = true;
+                progress = true;
+            }
+        }
+    }
+    for (const Target& target : targets_)
+    {
+        if (target.pushed)
+        {
+            target.injector->commit();
+        }
+    }
+
+    bool backlog = false;
+    for (QList<EventQueue*>::iterator queue = queues_.begin(); queue != queues_.end();)
+    {
+        if ((*queue)->isEmpty() && closedQueues_.remove(*queue))
+        {
+            delete *queue;
+            queue = queues_.erase(queue);
+            continue;
+        }
+        backlog = backlog || !(*queue)->isEmpty();
+        ++queue;
+    }
+    for (Connection* connection : connections_)
+    {
+        const EventQueue* queue = sourceQueues_.value(connection);
+        if (connection->isPaused() && queue->size() <= queue->capacity() / 2)
+        {
+            LOG_DEBUG("Server: resuming", connection->peerName());
+            connection->resume();
+        }
+    }
+
+    if (backlog && !drainTimer_.isActive())
+    {
+        drainTimer_.start();
+    }
+    else if (!backlog)
+    {
+        drainTimer_.stop();
+    }
+}
+
+//Applies the options of a hello. A client is routed to the display named in
+//it; clients asking for an unknown display are disconnected, replayed ones
+//stay on the first display.
+void Server::clientHello(const QByteArray& payload)
+{
+    Connection* connection = qobject_cast<Connection*>(sender());
+    if (!sourceQueues_.contains(sender()))
+    {
+        return;
+    }
+    QByteArray value;
+    if (connection != NULL && resumeTimeout_ > 0 && connection->session() == 0
+            && Protocol::helloOption(payload, Protocol::HelloOption::SESSION, value))
+    {
+        openSession(connection, value);
+    }
+    //A resumed session brings its own queue.
+    EventQueue* queue = sourceQueues_.value(sender());
+    if (connection != NULL && connection->ackClient() == 0
+            && Protocol::helloOption(payload, Protocol::HelloOption::ACKS, value))
+    {
+        connection->setAckClient(connection->client());
+        ackClients_.insert(connection->ackClient(), connection);
+        LOG_INFO("Server: client asked for acks", connection->peerName());
+    }
+    QByteArray display;
+    if (!Protocol::helloOption(payload, Protocol::HelloOption::DISPLAY, display))
+    {
+        return;
+    }
+    const QString peer = connection != NULL ? connection->peerName() : sender()->objectName();
+    const QString name = QString::fromUtf8(display);
+    for (int i = 0; i < targets_.size(); ++i)
+    {
+        if (targets_[i].name == name)
+        {
+            queue->setTarget(i);
+            LOG_INFO("Server: client uses display", peer + " " + name);
+            return;
+        }
+    }
+    LOG_WARNING("Server: client asked for unknown display", peer + " " + name);
+    if (connection != NULL)
+    {
+        connection->abort();
+    }
+}
+
+//Sends the acks of one injection thread, one frame per client however many
+//flushes they cover.
+void Server::sendAcks(int ackFd)
+{
+    for (const Target& target : targets_)
+    {
+        if (target.injector->ackFd() != ackFd)
+        {
+            continue;
+        }
+        target.injector->resetAckFd();
+        QHash<quint32, Injector::Ack> merged;
+        Injector::Ack ack;
+        while (target.injector->takeAck(ack))
+        {
+            const QHash<quint32, Injector::Ack>::iterator previous = merged.find(ack.client);
+            if (previous == merged.end())
+            {
+                merged.insert(ack.client, ack);
+                continue;
+            }
+            previous->sequence = ack.sequence;
+            previous->events += ack.events;
+            previous->oldest = qMax(previous->oldest, ack.oldest);
+            previous->newest = ack.newest;
+        }
+        for (const Injector::Ack& clientAck : merged)
+        {
+            Connection* connection = ackClients_.value(clientAck.client);
+            if (connection != NULL)
+            {
+                connection->sendAck(clientAck.sequence, clientAck.events, clientAck.oldest,
+                                    clientAck.newest);
+            }
+        }
+    }
+}
+
+//The injection threads start with the first listening socket so the inject
+//hook can still be set up after construction.
+void Server::startInjectors()
+{
+    for (const Target& target : targets_)
+    {
+        if (!target.injector->isRunning())
+        {
+            target.injector->start();
+        }
+    }
+}
+
+void Server::retireQueue(EventQueue* queue)
+{
+    if (queue->isEmpty())
+    {
+        queues_.removeOne(queue);
+        delete queue;
+    }
+    else
+    {
+        closedQueues_.insert(queue);
+    }
+}
+
+EventQueue* Server::addQueue(QObject* source, qint64 staleAfter, int overshoot)
+{
+    EventQueue* queue = new EventQueue(queueSize_, staleAfter, overshoot);
+    if (realtime_.lowLatency)
+    {
+        queue->prefault();
+    }
+    sourceQueues_.insert(source, queue);
+    queues_.append(queue);
+    return queue;
 }
@@ -2,34 +2,175 @@
 #define SERVER_H
 
 #include <QObject>
-#include <QMutex>
-#include <QtNetwork/QTcpSocket>
+#include <QSet>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+#include <QVector>
+#include <QStringList>
 #include <QtNetwork/QTcpServer>
-#include <X11/extensions/XTest.h>
+#include "messagedecoder.h"
+#include "stats.h"
+#include "injector.h"
+#include "realtime.h"
 
+class Connection;
+class EventQueue;
+class PlayoutClock;
+class Recorder;
+class UdpReceiver;
+class UdpPeer;
+class StatsServer;
+
+//Receives events from clients and routes them to one injection thread per
+//X display. Every display has its own connection, so displays do not wait
+//for each other.
 class Server : public QObject
 {
    Q_OBJECT
 public:
-    Server(QObject *parent = 0);
+    //backend is "xlib", "xcb" or "null", see InjectionBackend::create().
+    //Without displays $DISPLAY is used. The first display is the default
+    //one for clients that do not choose.
+    explicit Server(QObject *parent = 0, const QString& backend = "xlib",
+                    const QStringList& displays = QStringList());
     ~Server();
 
+    int displayCount() const;
+    Injector& injector(int display = 0);
+
     bool listen(const unsigned port);
+    //Also accepts messages as UDP datagrams on the given port.
+    bool listenUdp(const unsigned port, const unsigned holdTimeout);
+    //Delays the flush so events arriving within the window share one flush.
+    //Zero flushes as soon as the injection queue has been drained.
+    void setFlushWindow(const unsigned microseconds);
+    //Injects merged pointer motion at most once per tick.
+    void setMotionTick(const unsigned microseconds);
+    //Sets what happens when a client queues more than queueSize events:
+    //"block" stops reading from it, "drop" drops new presses and
+    //"disconnect" closes it. UDP clients cannot be blocked and always drop.
+    //Press/release pairs waiting longer than staleAfter (milliseconds, zero
+    //for never) are dropped. Affects clients connecting afterwards.
+    bool setOverloadPolicy(const QString& policy, const int queueSize, const unsigned staleAfter);
+    //Replays timestamped events with their original spacing, this long
+    //(milliseconds) after they would have arrived without jitter. Zero
+    //injects them at once.
+    void setPlayoutDelay(const unsigned milliseconds);
+    //Keeps the session of a closed client this long (milliseconds) for it
+    //to resume, see Protocol::HelloOption::SESSION. Zero disables sessions.
+    void setResumeTimeout(const unsigned milliseconds);
+    //Applies the low-latency profile to the calling (network) thread and
+    //the injection threads, see Realtime. Must be called before listening.
+    void setRealtime(const Realtime::Profile& profile);
+    //Records everything clients send to the file, see Recorder.
+    bool record(const QString& fileName);
+    //Replays a recording instead of listening and emits replayFinished()
+    //once every event has been handed to the injection threads.
+    bool replay(const QString& fileName, bool fast);
+    //Takes messages from a source other than a client socket, such as a
+    //replayed connection. Its messagesReceived and helloReceived signals are
+    //handled like those of a Connection, but it is never paused and its
+    //events are never dropped or go stale: it should wait while isFull().
+    void addSource(QObject* source);
+    void removeSource(QObject* source);
+    bool isFull(QObject* source) const;
+    //No events wait in the client queues or the injection queues.
+    bool isIdle() const;
+    //Enables the local stats socket in addition to the SIGUSR1 dump.
+    bool listenStats(const QString& name);
+
+    QString statsReport() const;
 signals:
+    void replayFinished();
 
 public slots:
     void newConnection();
+    void handleMessages(const MessageSpan& messages);
+    void connectionClosed(Connection* connection);
+
+private slots:
+    void drainQueues();
+    void clientHello(const QByteArray& payload);
+    void sendAcks(int ackFd);
+    void expireSessions();
+    void udpPeerAdded(UdpPeer* peer);
+    void udpPeerRemoved(UdpPeer* peer);
 
 private:
+    enum class OverloadPolicy
+    {
+        BLOCK,
+        DROP,
+        DISCONNECT
+    };
+
+    //One X display and the thread injecting into it.
+    struct Target
+    {
+        QString name;
+        Stats* stats;
+        Injector* injector;
+        //Scratch state of drainQueues().
+        bool pushed;
+        bool full;
+    };
+
+    //What a client keeps over reconnects. While no connection is attached
+    //the session holds the queue and clock of the client, so its queued
+    //events are still injected and survive a resume.
+    struct Session
+    {
+        quint32 client;
+        Connection* connection;
+        bool received; //lastSequence is set
+        quint32 lastSequence;
+        quint64 duplicates;
+        EventQueue* queue;
+        PlayoutClock* clock;
+        qint64 closedAt;
+    };
+
+    Stats stats_;
+    StatsServer* statsServer_;
     QTcpServer server_;
-    QTcpSocket* socket_;
-    unsigned messageSize_;
-    Display* display_; //unique_ptr doesn't work.
-    QMutex newConnectionMutex_;
-
-    void pressKey(const unsigned keyCode);
-    void releaseKey(const unsigned keyCode);
-    unsigned QtKeyToXKeySym(Qt::Key key);
+    QSet<Connection*> connections_;
+    UdpReceiver* udpReceiver_;
+    QVector<Target> targets_;
+    OverloadPolicy overloadPolicy_;
+    int queueSize_;
+    qint64 staleAfter_;
+    //Queue of each client, keyed by the Connection or UdpPeer.
+    QHash<QObject*, EventQueue*> sourceQueues_;
+    //Every queue in drain order, including those of closed clients whose
+    //remaining events are still injected.
+    QList<EventQueue*> queues_;
+    QSet<EventQueue*> closedQueues_;
+    qint64 playoutDelay_;
+    //Clock of each client that has sent timestamped events.
+    QHash<QObject*, PlayoutClock*> clocks_;
+    Recorder* recorder_;
+    Realtime::Profile realtime_;
+    quint32 nextStream_;
+    quint32 lastClient_;
+    //Connections that asked for acks, by Connection::ackClient().
+    QHash<quint32, Connection*> ackClients_;
+    //Sessions by token, with or without a connection.
+    QHash<quint64, Session> sessions_;
+    qint64 resumeTimeout_;
+    //Runs while sessions wait for their client to come back.
+    QTimer sessionTimer_;
+    //Retries draining while the injection queue is full.
+    QTimer drainTimer_;
+
+    void startInjectors();
+    EventQueue* addQueue(QObject* source, qint64 staleAfter, int overshoot);
+    void connectSource(QObject* source);
+    void retireQueue(EventQueue* queue);
+    bool queueRelease(QObject* source, quint32 client);
+    void releaseClient(Connection* connection);
+    void openSession(Connection* connection, const QByteArray& requested);
+    quint64 newSessionToken() const;
 };
 
 #endif // SERVER_H
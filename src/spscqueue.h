@@ -0,0 +1,122 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QtGlobal>
+#include <atomic>
+
+//Bounded lock-free single-producer single-consumer queue. Capacity is
+//rounded up to a power of two. The producer and consumer indexes live on
+//separate cache lines and each side caches the other's index, so a push or
+//pop touches shared memory only when the cached view runs out.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) :
+        capacity_(roundUp(capacity)),
+        mask_(capacity_ - 1),
+        items_(new T[capacity_]),
+        head_(0),
+        cachedTail_(0),
+        tail_(0),
+        cachedHead_(0)
+    {
+    }
+
+    ~SpscQueue()
+    {
+        delete[] items_;
+    }
+
+    //Producer side. Returns false when the queue is full.
+    inline bool push(const T& item)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ == capacity_)
+        {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ == capacity_)
+            {
+                return false;
+            }
+        }
+        items_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Consumer side. Returns false when the queue is empty.
+    inline bool pop(T& item)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_)
+        {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_)
+            {
+                return false;
+            }
+        }
+        item = items_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //Approximate when called from a third thread.
+    inline bool isEmpty() const
+    {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    inline size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    //Writes every slot so the first pass through the queue does not fault
+    //pages in. Only before the first push.
+    void prefault()
+    {
+        for (size_t i = 0; i < capacity_; ++i)
+        {
+            items_[i] = T();
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+
+    static size_t roundUp(size_t value)
+    {
+        size_t result = 1;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    static const size_t CACHE_LINE = 64;
+
+    const size_t capacity_;
+    const size_t mask_;
+    T* const items_;
+
+    //Padding instead of alignas keeps the queue usable with plain new.
+    char padding0_[CACHE_LINE];
+    //Consumer.
+    std::atomic<size_t> head_;
+    size_t cachedTail_;
+    char padding1_[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    //Producer.
+    std::atomic<size_t> tail_;
+    size_t cachedHead_;
+    char padding2_[CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,64 @@
+# Server sources shared by kaukkis-server and the benchmark.
+
+QT       += core network gui
+
+CONFIG += C++11
+LIBS += -lXtst -lX11 -lxcb -lxcb-xtest
+
+# Log levels below this are compiled out: 0 debug, 1 info, 2 warning, 3 error.
+CONFIG(debug, debug|release) {
+    DEFINES += KAUKKIS_LOG_LEVEL=0
+} else {
+    DEFINES += KAUKKIS_LOG_LEVEL=1
+}
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/server.cpp \
+    $$PWD/message.cpp \
+    $$PWD/connection.cpp \
+    $$PWD/keymap.cpp \
+    $$PWD/keycodepool.cpp \
+    $$PWD/messagedecoder.cpp \
+    $$PWD/udpreceiver.cpp \
+    $$PWD/histogram.cpp \
+    $$PWD/stats.cpp \
+    $$PWD/statsserver.cpp \
+    $$PWD/log.cpp \
+    $$PWD/injector.cpp \
+    $$PWD/eventqueue.cpp \
+    $$PWD/playoutclock.cpp \
+    $$PWD/recorder.cpp \
+    $$PWD/replayer.cpp \
+    $$PWD/realtime.cpp \
+    $$PWD/injectionbackend.cpp \
+    $$PWD/xlibbackend.cpp \
+    $$PWD/xcbbackend.cpp \
+    $$PWD/nullbackend.cpp
+
+HEADERS += \
+    $$PWD/server.h \
+    $$PWD/message.h \
+    $$PWD/connection.h \
+    $$PWD/keymap.h \
+    $$PWD/keycodepool.h \
+    $$PWD/messagedecoder.h \
+    $$PWD/protocol.h \
+    $$PWD/udpreceiver.h \
+    $$PWD/histogram.h \
+    $$PWD/stats.h \
+    $$PWD/statsserver.h \
+    $$PWD/log.h \
+    $$PWD/inputevent.h \
+    $$PWD/spscqueue.h \
+    $$PWD/injector.h \
+    $$PWD/eventqueue.h \
+    $$PWD/playoutclock.h \
+    $$PWD/recorder.h \
+    $$PWD/replayer.h \
+    $$PWD/realtime.h \
+    $$PWD/injectionbackend.h \
+    $$PWD/xlibbackend.h \
+    $$PWD/xcbbackend.h \
+    $$PWD/nullbackend.h
@@ -0,0 +1,67 @@
+#include "stats.h"
+
+namespace
+{
+    const char* const STAGE_NAMES[] = {
+        "read", "decode", "lookup", "inject", "flush", "end_to_end", "playout"
+    };
+
+    QString micros(quint64 nanoseconds)
+    {
+        return QString::number(nanoseconds / 1000.0, 'f', 1);
+    }
+}
+
+Stats::Stats(QObject* parent) :
+    QObject(parent),
+    events_(0),
+    bytes_(0),
+    started_(now()),
+    sampledEvents_(0),
+    sampledBytes_(0),
+    eventsPerSecond_(0),
+    bytesPerSecond_(0)
+{
+    connect(&sampleTimer_, SIGNAL(timeout()),
+            this, SLOT(sample()));
+    sampleTimer_.start(1000);
+}
+
+//Rates are measured over the last second.
+void Stats::sample()
+{
+    eventsPerSecond_ = events_ - sampledEvents_;
+    bytesPerSecond_ = bytes_ - sampledBytes_;
+    sampledEvents_ = events_;
+    sampledBytes_ = bytes_;
+}
+
+QString Stats::report() const
+{
+    QString text;
+    text += "uptime_s " + QString::number((now() - started_) / 1e9, 'f', 1) + "\n";
+    text += "events " + QString::number(events_)
+            + " events_per_s " + QString::number(eventsPerSecond_, 'f', 0) + "\n";
+    text += "bytes " + QString::number(bytes_)
+            + " bytes_per_s " + QString::number(bytesPerSecond_, 'f', 0) + "\n";
+    return text + stagesReport();
+}
+
+QString Stats::stagesReport() const
+{
+    QString text = "stage count p50_us p99_us p999_us max_us\n";
+    for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+        const LatencyHistogram& stage = stages_[i];
+        if (stage.count() == 0)
+        {
+            continue;
+        }
+        text += QString(STAGE_NAMES[i]) + " " + QString::number(stage.count())
+                + " " + micros(stage.percentile(0.5))
+                + " " + micros(stage.percentile(0.99))
+                + " " + micros(stage.percentile(0.999))
+                + " " + micros(stage.max()) + "\n";
+    }
+    return text;
+}
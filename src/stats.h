@@ -0,0 +1,69 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <QObject>
+#include <QTimer>
+#include <QString>
+#include <ctime>
+#include "histogram.h"
+
+//Counters and per-stage latency histograms of the path from a readable
+//socket to the X server. Every injection thread records into a Stats of its
+//own, as the histograms allow a single writer only.
+class Stats : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stage
+    {
+        READ,       //readyRead to bytes copied out of the socket
+        DECODE,     //frame decoding of one read
+        LOOKUP,     //Qt key to X keycode, per event
+        INJECT,     //backend fake key event, per event
+        FLUSH,      //backend flush
+        END_TO_END, //readyRead to flush done, per event
+        PLAYOUT,    //timed events: scheduled playout time to injection
+        STAGE_COUNT
+    };
+
+    explicit Stats(QObject* parent = 0);
+
+    //Monotonic clock in nanoseconds.
+    static inline qint64 now()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return static_cast<qint64>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+
+    inline void record(Stage stage, qint64 nanoseconds, quint64 count = 1)
+    {
+        stages_[stage].record(nanoseconds, count);
+    }
+
+    inline void addReceived(quint64 events, quint64 bytes)
+    {
+        events_ += events;
+        bytes_ += bytes;
+    }
+
+    QString report() const;
+    //Only the stage table. Stages without samples are left out.
+    QString stagesReport() const;
+
+private slots:
+    void sample();
+
+private:
+    LatencyHistogram stages_[STAGE_COUNT];
+    quint64 events_;
+    quint64 bytes_;
+    qint64 started_;
+    QTimer sampleTimer_;
+    quint64 sampledEvents_;
+    quint64 sampledBytes_;
+    double eventsPerSecond_;
+    double bytesPerSecond_;
+};
+
+#endif // STATS_H
@@ -0,0 +1,90 @@
+#include "statsserver.h"
+#include "server.h"
+#include <QtNetwork/QLocalSocket>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int StatsServer::signalFds_[2] = { -1, -1 };
+
+StatsServer::StatsServer(const Server* server, QObject* parent) :
+    QObject(parent),
+    server_(server),
+    signalNotifier_(NULL)
+{
+    connect(&localServer_, SIGNAL(newConnection()),
+            this, SLOT(newConnection()));
+    //Signal handlers may only do async-signal-safe work, so the handler
+    //wakes the event loop through a socket pair.
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, signalFds_) != 0)
+    {
+        qDebug() << "StatsServer: SIGUSR1 dump not available.";
+        return;
+    }
+    signalNotifier_ = new QSocketNotifier(signalFds_[1], QSocketNotifier::Read, this);
+    connect(signalNotifier_, SIGNAL(activated(int)),
+            this, SLOT(signalReceived()));
+
+    struct sigaction action = {};
+    action.sa_handler = signalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+StatsServer::~StatsServer()
+{
+    signal(SIGUSR1, SIG_DFL);
+    delete signalNotifier_;
+    for (int& fd : signalFds_)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+
+bool StatsServer::listen(const QString& name)
+{
+    QLocalServer::removeServer(name);
+    if (localServer_.listen(name))
+    {
+        qDebug() << "StatsServer: stats socket: " << localServer_.fullServerName();
+        return true;
+    }
+    qDebug() << "StatsServer could not start because: " + localServer_.errorString();
+    return false;
+}
+
+void StatsServer::signalHandler(int)
+{
+    const char byte = 1;
+    if (write(signalFds_[0], &byte, sizeof(byte)) < 0)
+    {
+        return;
+    }
+}
+
+void StatsServer::signalReceived()
+{
+    char byte;
+    if (read(signalFds_[1], &byte, sizeof(byte)) < 0)
+    {
+        return;
+    }
+    qDebug().noquote() << "Server: stats\n" + server_->statsReport();
+}
+
+void StatsServer::newConnection()
+{
+    while (localServer_.hasPendingConnections())
+    {
+        QLocalSocket* socket = localServer_.nextPendingConnection();
+        connect(socket, SIGNAL(disconnected()),
+                socket, SLOT(deleteLater()));
+        socket->write(server_->statsReport().toUtf8());
+        socket->disconnectFromServer();
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef STATSSERVER_H
+#define STATSSERVER_H
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QtNetwork/QLocalServer>
+
+class Server;
+
+//Makes the server statistics visible without a debugger: SIGUSR1 dumps them
+//to the log and every client of the local stats socket gets a copy.
+class StatsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StatsServer(const Server* server, QObject* parent = 0);
+    ~StatsServer();
+
+    bool listen(const QString& name);
+
+private slots:
+    void signalReceived();
+    void newConnection();
+
+private:
+    const Server* server_;
+    QLocalServer localServer_;
+    QSocketNotifier* signalNotifier_;
+
+    static int signalFds_[2];
+    static void signalHandler(int);
+};
+
+#endif // STATSSERVER_H
@@ -0,0 +1,235 @@
+#include "udpreceiver.h"
+#include "stats.h"
+#include "log.h"
+#include <limits>
+
+UdpPeer::UdpPeer(const QHostAddress& address, quint16 port, QObject* parent) :
+    QObject(parent),
+    peerName_(address.toString() + ":" + QString::number(port)),
+    client_(0),
+    sequence_(0),
+    lastSeen_(0)
+{
+}
+
+QString UdpPeer::peerName() const
+{
+    return peerName_;
+}
+
+quint32 UdpPeer::client() const
+{
+    return client_;
+}
+
+void UdpPeer::setClient(quint32 client)
+{
+    client_ = client;
+}
+
+UdpReceiver::UdpReceiver(Stats* stats, QObject* parent) :
+    QObject(parent),
+    stats_(stats),
+    holdTimeout_(500),
+    datagram_(new char[MAX_DATAGRAM_SIZE]),
+    messages_(new Message[MAX_MESSAGES]),
+    dropped_(0)
+{
+    clock_.start();
+    expiryTimer_.setInterval(holdTimeout_ / 2);
+    connect(&socket_, SIGNAL(readyRead()),
+            this, SLOT(readDatagrams()));
+    connect(&expiryTimer_, SIGNAL(timeout()),
+            this, SLOT(releaseExpiredKeys()));
+}
+
+UdpReceiver::~UdpReceiver()
+{
+    delete[] datagram_;
+    delete[] messages_;
+}
+
+bool UdpReceiver::listen(const unsigned port)
+{
+    if (socket_.bind(QHostAddress::Any, port))
+    {
+        qDebug() << "UdpReceiver: listening port: " << port;
+        expiryTimer_.start();
+        return true;
+    }
+    qDebug() << "UdpReceiver could not start because: " + socket_.errorString();
+    return false;
+}
+
+void UdpReceiver::setHoldTimeout(const unsigned milliseconds)
+{
+    holdTimeout_ = qMax(milliseconds, 2u);
+    expiryTimer_.setInterval(holdTimeout_ / 2);
+}
+
+quint64 UdpReceiver::dropped() const
+{
+    return dropped_;
+}
+
+QList<UdpPeer*> UdpReceiver::peers() const
+{
+    return peers_.values();
+}
+
+void UdpReceiver::readDatagrams()
+{
+    const qint64 readyAt = Stats::now();
+    while (socket_.hasPendingDatagrams())
+    {
+        PeerId peerId;
+        const qint64 size = socket_.readDatagram(datagram_, MAX_DATAGRAM_SIZE,
+                                                 &peerId.first, &peerId.second);
+        if (size < 4)
+        {
+            continue;
+        }
+        stats_->addReceived(0, size);
+        const quint32 sequence = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(datagram_));
+        UdpPeer*& peer = peers_[peerId];
+        if (peer == NULL)
+        {
+            peer = new UdpPeer(peerId.first, peerId.second, this);
+            peer->sequence_ = sequence - 1;
+            LOG_INFO("UdpReceiver: new client", peer->peerName());
+            emit peerAdded(peer);
+        }
+        //Serial number comparison handles wrap-around.
+        const qint32 ahead = static_cast<qint32>(sequence - peer->sequence_);
+        if (ahead <= 0)
+        {
+            if (ahead > -REORDER_WINDOW)
+            {
+                ++dropped_;
+                continue;
+            }
+            //A restarted client holds nothing.
+            LOG_INFO("UdpReceiver: client restarted", peer->peerName());
+            releaseHeldKeys(peer, std::numeric_limits<qint64>::max());
+        }
+        peer->sequence_ = sequence;
+        peer->lastSeen_ = clock_.elapsed();
+        handleDatagram(peer, size, readyAt);
+    }
+}
+
+//Repeated presses of held keys and buttons refresh their hold instead of
+//being injected.
+void UdpReceiver::handleDatagram(UdpPeer* peer, int size, qint64 receivedAt)
+{
+    const int frames = (size - 4) / Message::SIZE;
+    const char* frame = datagram_ + 4;
+    int count = 0;
+    for (int i = 0; i < frames; ++i, frame += Message::SIZE)
+    {
+        Message& msg = messages_[count];
+        msg.deSerialize(frame);
+        if (msg.action() < Message::Action::KEY_PRESS || msg.action() > Message::Action::SCROLL)
+        {
+            continue;
+        }
+        QHash<quint32, qint64>* held = NULL;
+        bool press = false;
+        switch (msg.action())
+        {
+            case Message::Action::KEY_PRESS:
+                press = true;
+                held = &peer->heldKeys_;
+                break;
+            case Message::Action::KEY_RELEASE:
+                held = &peer->heldKeys_;
+                break;
+            case Message::Action::BUTTON_PRESS:
+                press = true;
+                held = &peer->heldButtons_;
+                break;
+            case Message::Action::BUTTON_RELEASE:
+                held = &peer->heldButtons_;
+                break;
+            default:
+                break;
+        }
+        if (held != NULL && press)
+        {
+            const bool repeated = held->contains(msg.key());
+            held->insert(msg.key(), peer->lastSeen_);
+            if (repeated)
+            {
+                continue;
+            }
+        }
+        else if (held != NULL)
+        {
+            held->remove(msg.key());
+        }
+        ++count;
+    }
+    if (count > 0)
+    {
+        stats_->record(Stats::DECODE, Stats::now() - receivedAt);
+        stats_->addReceived(count, 0);
+        MessageSpan messages = { messages_, count, receivedAt };
+        emit peer->messagesReceived(messages);
+    }
+}
+
+//Releases the keys and buttons whose press has not been repeated within the
+//hold timeout. Silent clients holding nothing are forgotten after a while.
+void UdpReceiver::releaseExpiredKeys()
+{
+    const qint64 now = clock_.elapsed();
+    QHash<PeerId, UdpPeer*>::iterator peer = peers_.begin();
+    while (peer != peers_.end())
+    {
+        UdpPeer* udpPeer = peer.value();
+        releaseHeldKeys(udpPeer, now - holdTimeout_);
+        const bool holding = !udpPeer->heldKeys_.isEmpty() || !udpPeer->heldButtons_.isEmpty();
+        if (!holding && now - udpPeer->lastSeen_ > FORGET_AFTER)
+        {
+            emit peerRemoved(udpPeer);
+            udpPeer->deleteLater();
+            peer = peers_.erase(peer);
+            continue;
+        }
+        ++peer;
+    }
+}
+
+//Releases what the peer has held since before heldSince (clock_ time).
+void UdpReceiver::releaseHeldKeys(UdpPeer* peer, qint64 heldSince)
+{
+    int count = 0;
+    for (QHash<quint32, qint64>::iterator key = peer->heldKeys_.begin(); key != peer->heldKeys_.end();)
+    {
+        if (key.value() >= heldSince || count == MAX_MESSAGES)
+        {
+            ++key;
+            continue;
+        }
+        messages_[count++] = Message(Message::Action::KEY_RELEASE, static_cast<Qt::Key>(key.key()));
+        key = peer->heldKeys_.erase(key);
+    }
+    for (QHash<quint32, qint64>::iterator button = peer->heldButtons_.begin();
+         button != peer->heldButtons_.end();)
+    {
+        if (button.value() >= heldSince || count == MAX_MESSAGES)
+        {
+            ++button;
+            continue;
+        }
+        messages_[count++] = Message(Message::Action::BUTTON_RELEASE, static_cast<Qt::Key>(button.key()));
+        button = peer->heldButtons_.erase(button);
+    }
+    if (count == 0)
+    {
+        return;
+    }
+    LOG_WARNING("UdpReceiver: releasing keys not kept alive", peer->peerName(), Log::field("released", count));
+    MessageSpan messages = { messages_, count, Stats::now() };
+    emit peer->messagesReceived(messages);
+}
@@ -0,0 +1,103 @@
+#ifndef UDPRECEIVER_H
+#define UDPRECEIVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QPair>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QtNetwork/QUdpSocket>
+#include <QtNetwork/QHostAddress>
+#include "messagedecoder.h"
+
+class Stats;
+
+//One UDP client, identified by its address and port. The server gives
+//every peer its own queue, like a connection.
+class UdpPeer : public QObject
+{
+    Q_OBJECT
+public:
+    UdpPeer(const QHostAddress& address, quint16 port, QObject* parent = 0);
+
+    QString peerName() const;
+    //Identifies the client to the injection threads, see Connection::client().
+    quint32 client() const;
+    void setClient(quint32 client);
+
+signals:
+    void messagesReceived(const MessageSpan& messages);
+
+private:
+    friend class UdpReceiver;
+
+    QString peerName_;
+    quint32 client_;
+    quint32 sequence_;
+    qint64 lastSeen_;
+    //Held keys and buttons by the time their press was last repeated.
+    QHash<quint32, qint64> heldKeys_;
+    QHash<quint32, qint64> heldButtons_;
+};
+
+//Receives Message frames over UDP. Each datagram is a 32-bit big-endian
+//sequence number followed by Message frames. Duplicate and reordered
+//datagrams are dropped instead of waiting for retransmission, so a lost
+//datagram never delays the ones behind it. A datagram further behind than
+//reordering explains comes from a restarted client and starts the peer
+//over.
+//
+//A lost datagram may have carried a release. Every held key and button is
+//released on its own once its press has not been repeated within the hold
+//timeout, so clients holding keys should send keep-alive datagrams that
+//repeat the press of each held key more often than that. Repeated presses
+//only refresh the hold and are not injected again.
+class UdpReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit UdpReceiver(Stats* stats, QObject* parent = 0);
+    ~UdpReceiver();
+
+    bool listen(const unsigned port);
+    void setHoldTimeout(const unsigned milliseconds);
+    //Number of duplicate or reordered datagrams dropped.
+    quint64 dropped() const;
+    QList<UdpPeer*> peers() const;
+
+signals:
+    //A peer sent its first datagram. Its messagesReceived signal follows.
+    void peerAdded(UdpPeer* peer);
+    //A peer holding nothing has been silent for long. It is deleted later.
+    void peerRemoved(UdpPeer* peer);
+
+private slots:
+    void readDatagrams();
+    void releaseExpiredKeys();
+
+private:
+    typedef QPair<QHostAddress, quint16> PeerId;
+
+    static const int MAX_DATAGRAM_SIZE = 64 * 1024;
+    static const int MAX_MESSAGES = MAX_DATAGRAM_SIZE / Message::SIZE;
+    //Datagrams a reordered one may lag behind before the peer is taken
+    //for a restarted client.
+    static const qint32 REORDER_WINDOW = 64;
+    //Silence after which a peer holding nothing is forgotten, milliseconds.
+    static const qint64 FORGET_AFTER = 60 * 1000;
+
+    Stats* stats_;
+    QUdpSocket socket_;
+    QHash<PeerId, UdpPeer*> peers_;
+    QTimer expiryTimer_;
+    QElapsedTimer clock_;
+    unsigned holdTimeout_;
+    char* datagram_;
+    Message* messages_;
+    quint64 dropped_;
+
+    void handleDatagram(UdpPeer* peer, int size, qint64 receivedAt);
+    void releaseHeldKeys(UdpPeer* peer, qint64 heldSince);
+};
+
+#endif // UDPRECEIVER_H
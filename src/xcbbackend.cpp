@@ -0,0 +1,157 @@
+#include "xcbbackend.h"
+#include "keymap.h"
+#include "log.h"
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+#include <cstdlib>
+
+XcbBackend::XcbBackend() :
+    connection_(NULL),
+    root_(0),
+    buttonCount_(0),
+    errors_(0)
+{
+}
+
+XcbBackend::~XcbBackend()
+{
+    if (connection_ != NULL)
+    {
+        xcb_flush(connection_);
+        xcb_disconnect(connection_);
+    }
+}
+
+bool XcbBackend::open(const char* displayName)
+{
+    int screenNumber = 0;
+    connection_ = xcb_connect(displayName, &screenNumber);
+    if (xcb_connection_has_error(connection_))
+    {
+        xcb_disconnect(connection_);
+        connection_ = NULL;
+        return false;
+    }
+    const xcb_query_extension_reply_t* xtest = xcb_get_extension_data(connection_, &xcb_test_id);
+    if (xtest == NULL || !xtest->present)
+    {
+        LOG_ERROR("XcbBackend: XTEST extension missing");
+        xcb_disconnect(connection_);
+        connection_ = NULL;
+        return false;
+    }
+    xcb_screen_iterator_t screen = xcb_setup_roots_iterator(xcb_get_setup(connection_));
+    for (int i = 0; i < screenNumber && screen.rem > 0; ++i)
+    {
+        xcb_screen_next(&screen);
+    }
+    root_ = screen.data != NULL ? screen.data->root : 0;
+    loadButtonCount();
+    return true;
+}
+
+void XcbBackend::loadButtonCount()
+{
+    xcb_get_pointer_mapping_reply_t* reply = xcb_get_pointer_mapping_reply(
+                connection_, xcb_get_pointer_mapping(connection_), NULL);
+    buttonCount_ = reply != NULL ? reply->map_len : 0;
+    free(reply);
+}
+
+void XcbBackend::loadKeyMap(KeyMap& keyMap)
+{
+    const xcb_setup_t* setup = xcb_get_setup(connection_);
+    const int count = setup->max_keycode - setup->min_keycode + 1;
+    xcb_get_keyboard_mapping_reply_t* reply = xcb_get_keyboard_mapping_reply(
+                connection_, xcb_get_keyboard_mapping(connection_, setup->min_keycode, count), NULL);
+    if (reply == NULL)
+    {
+        keyMap.rebuild(NULL, setup->min_keycode, 0, 0);
+        return;
+    }
+    keyMap.rebuild(xcb_get_keyboard_mapping_keysyms(reply), setup->min_keycode, count,
+                   reply->keysyms_per_keycode);
+    free(reply);
+}
+
+void XcbBackend::fakeKey(KeyCode keyCode, bool press)
+{
+    xcb_test_fake_input(connection_, press ? XCB_KEY_PRESS : XCB_KEY_RELEASE, keyCode,
+                        XCB_CURRENT_TIME, root_, 0, 0, 0);
+}
+
+void XcbBackend::remapKey(KeyCode keyCode, quint32 keySym)
+{
+    //Both levels, so Shift does not turn the keysym into its other case.
+    const xcb_keysym_t keySyms[2] = { keySym, keySym };
+    xcb_change_keyboard_mapping(connection_, 1, keyCode, 2, keySyms);
+    expectRemap(keyCode);
+}
+
+void XcbBackend::fakeMotion(int dx, int dy)
+{
+    //A non-zero detail makes the motion relative.
+    xcb_test_fake_input(connection_, XCB_MOTION_NOTIFY, 1, XCB_CURRENT_TIME, XCB_NONE, dx, dy, 0);
+}
+
+void XcbBackend::fakePosition(int x, int y)
+{
+    xcb_test_fake_input(connection_, XCB_MOTION_NOTIFY, 0, XCB_CURRENT_TIME, root_, x, y, 0);
+}
+
+void XcbBackend::fakeButton(unsigned button, bool press)
+{
+    xcb_test_fake_input(connection_, press ? XCB_BUTTON_PRESS : XCB_BUTTON_RELEASE, button,
+                        XCB_CURRENT_TIME, root_, 0, 0, 0);
+}
+
+unsigned XcbBackend::buttonCount() const
+{
+    return buttonCount_;
+}
+
+void XcbBackend::flush()
+{
+    xcb_flush(connection_);
+}
+
+int XcbBackend::fd() const
+{
+    return xcb_get_file_descriptor(connection_);
+}
+
+bool XcbBackend::processEvents()
+{
+    bool mappingChanged = false;
+    while (xcb_generic_event_t* event = xcb_poll_for_event(connection_))
+    {
+        //Requests are unchecked, so errors arrive as events and only lose
+        //the request that caused them.
+        if (event->response_type == 0)
+        {
+            const xcb_generic_error_t* error = reinterpret_cast<const xcb_generic_error_t*>(event);
+            LOG_WARNING("XcbBackend: X error", Log::field("code", error->error_code),
+                        Log::field("request", error->major_code), Log::field("minor", error->minor_code),
+                        Log::field("errors", ++errors_));
+        }
+        else if ((event->response_type & ~0x80) == XCB_MAPPING_NOTIFY)
+        {
+            const xcb_mapping_notify_event_t* mapping =
+                    reinterpret_cast<const xcb_mapping_notify_event_t*>(event);
+            const bool ours = mapping->request == XCB_MAPPING_KEYBOARD
+                    && takeRemap(mapping->first_keycode, mapping->count);
+            if (mapping->request == XCB_MAPPING_POINTER)
+            {
+                loadButtonCount();
+            }
+            mappingChanged = mappingChanged || (mapping->request != XCB_MAPPING_POINTER && !ours);
+        }
+        free(event);
+    }
+    return mappingChanged;
+}
+
+bool XcbBackend::failed() const
+{
+    return xcb_connection_has_error(connection_) != 0;
+}
@@ -0,0 +1,39 @@
+#ifndef XCBBACKEND_H
+#define XCBBACKEND_H
+
+#include "injectionbackend.h"
+
+struct xcb_connection_t;
+
+//XTest through XCB. xcb_test_fake_input is a request without a reply, so
+//events are only appended to the output buffer and pipelined to the server
+//on flush without any round trip.
+class XcbBackend : public InjectionBackend
+{
+public:
+    XcbBackend();
+    ~XcbBackend();
+
+    bool open(const char* displayName) override;
+    void loadKeyMap(KeyMap& keyMap) override;
+    void fakeKey(KeyCode keyCode, bool press) override;
+    void remapKey(KeyCode keyCode, quint32 keySym) override;
+    void fakeMotion(int dx, int dy) override;
+    void fakePosition(int x, int y) override;
+    void fakeButton(unsigned button, bool press) override;
+    unsigned buttonCount() const override;
+    void flush() override;
+    int fd() const override;
+    bool processEvents() override;
+    bool failed() const override;
+
+private:
+    xcb_connection_t* connection_;
+    quint32 root_;
+    unsigned buttonCount_;
+    quint64 errors_;
+
+    void loadButtonCount();
+};
+
+#endif // XCBBACKEND_H
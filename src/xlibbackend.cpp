@@ -0,0 +1,163 @@
+#include <QVector>
+#include "xlibbackend.h"
+#include "keymap.h"
+#include "log.h"
+#include <X11/extensions/XTest.h>
+#include <atomic>
+
+namespace
+{
+    //Errors of every display; the error handler is process wide.
+    std::atomic<quint64> errors(0);
+}
+
+XlibBackend::XlibBackend() :
+    display_(NULL),
+    failed_(false),
+    buttonCount_(0)
+{
+}
+
+XlibBackend::~XlibBackend()
+{
+    if (display_ != NULL)
+    {
+        if (!failed_)
+        {
+            XFlush(display_);
+        }
+        XCloseDisplay(display_);
+    }
+}
+
+bool XlibBackend::open(const char* displayName)
+{
+    display_ = XOpenDisplay(displayName);
+    if (display_ == NULL)
+    {
+        return false;
+    }
+    //Xlib exits the process on a lost connection unless the exit handler
+    //returns (libX11 1.7 and later).
+    XSetIOErrorExitHandler(display_, &XlibBackend::ioErrorExit, this);
+    //The default error handler exits the process as well.
+    XSetErrorHandler(&XlibBackend::logError);
+    loadButtonCount();
+    return true;
+}
+
+void XlibBackend::ioErrorExit(Display*, void* backend)
+{
+    static_cast<XlibBackend*>(backend)->failed_ = true;
+}
+
+//A request the X server rejects, such as a remap outside its keycode range,
+//only loses that request.
+int XlibBackend::logError(Display* display, XErrorEvent* error)
+{
+    char text[128];
+    XGetErrorText(display, error->error_code, text, sizeof(text));
+    LOG_WARNING("XlibBackend: X error", QString::fromLocal8Bit(text),
+                Log::field("request", error->request_code), Log::field("minor", error->minor_code),
+                Log::field("errors", ++errors));
+    return 0;
+}
+
+void XlibBackend::loadButtonCount()
+{
+    unsigned char map[256];
+    buttonCount_ = qMax(XGetPointerMapping(display_, map, sizeof(map)), 0);
+}
+
+void XlibBackend::loadKeyMap(KeyMap& keyMap)
+{
+    int minKeyCode = 0;
+    int maxKeyCode = 0;
+    int keySymsPerKeyCode = 0;
+    XDisplayKeycodes(display_, &minKeyCode, &maxKeyCode);
+    const int count = maxKeyCode - minKeyCode + 1;
+    KeySym* keySyms = XGetKeyboardMapping(display_, minKeyCode, count, &keySymsPerKeyCode);
+    if (keySyms == NULL)
+    {
+        keyMap.rebuild(NULL, minKeyCode, 0, 0);
+        return;
+    }
+    //KeySym is a long; keysyms themselves fit in 29 bits.
+    QVector<quint32> mapping(count * keySymsPerKeyCode);
+    for (int i = 0; i < mapping.size(); ++i)
+    {
+        mapping[i] = static_cast<quint32>(keySyms[i]);
+    }
+    XFree(keySyms);
+    keyMap.rebuild(mapping.constData(), minKeyCode, count, keySymsPerKeyCode);
+}
+
+void XlibBackend::fakeKey(KeyCode keyCode, bool press)
+{
+    XTestFakeKeyEvent(display_, keyCode, press ? True : False, 0);
+}
+
+void XlibBackend::remapKey(KeyCode keyCode, quint32 keySym)
+{
+    //Both levels, so Shift does not turn the keysym into its other case.
+    KeySym keySyms[2] = { keySym, keySym };
+    XChangeKeyboardMapping(display_, keyCode, 2, keySyms, 1);
+    expectRemap(keyCode);
+}
+
+void XlibBackend::fakeMotion(int dx, int dy)
+{
+    XTestFakeRelativeMotionEvent(display_, dx, dy, 0);
+}
+
+void XlibBackend::fakePosition(int x, int y)
+{
+    XTestFakeMotionEvent(display_, -1, x, y, 0);
+}
+
+void XlibBackend::fakeButton(unsigned button, bool press)
+{
+    XTestFakeButtonEvent(display_, button, press ? True : False, 0);
+}
+
+unsigned XlibBackend::buttonCount() const
+{
+    return buttonCount_;
+}
+
+void XlibBackend::flush()
+{
+    XFlush(display_);
+}
+
+int XlibBackend::fd() const
+{
+    return ConnectionNumber(display_);
+}
+
+bool XlibBackend::processEvents()
+{
+    bool mappingChanged = false;
+    while (XPending(display_) > 0)
+    {
+        XEvent event;
+        XNextEvent(display_, &event);
+        if (event.type == MappingNotify)
+        {
+            XRefreshKeyboardMapping(&event.xmapping);
+            if (event.xmapping.request == MappingPointer)
+            {
+                loadButtonCount();
+            }
+            const bool ours = event.xmapping.request == MappingKeyboard
+                    && takeRemap(event.xmapping.first_keycode, event.xmapping.count);
+            mappingChanged = mappingChanged || (event.xmapping.request != MappingPointer && !ours);
+        }
+    }
+    return mappingChanged;
+}
+
+bool XlibBackend::failed() const
+{
+    return failed_;
+}
@@ -0,0 +1,36 @@
+#ifndef XLIBBACKEND_H
+#define XLIBBACKEND_H
+
+#include "injectionbackend.h"
+
+//Default backend: XTest through Xlib.
+class XlibBackend : public InjectionBackend
+{
+public:
+    XlibBackend();
+    ~XlibBackend();
+
+    bool open(const char* displayName) override;
+    void loadKeyMap(KeyMap& keyMap) override;
+    void fakeKey(KeyCode keyCode, bool press) override;
+    void remapKey(KeyCode keyCode, quint32 keySym) override;
+    void fakeMotion(int dx, int dy) override;
+    void fakePosition(int x, int y) override;
+    void fakeButton(unsigned button, bool press) override;
+    unsigned buttonCount() const override;
+    void flush() override;
+    int fd() const override;
+    bool processEvents() override;
+    bool failed() const override;
+
+private:
+    Display* display_; //unique_ptr doesn't work.
+    bool failed_;
+    unsigned buttonCount_;
+
+    void loadButtonCount();
+    static void ioErrorExit(Display* display, void* backend);
+    static int logError(Display* display, XErrorEvent* error);
+};
+
+#endif // XLIBBACKEND_H